@@ -0,0 +1,193 @@
+/*
+Benchmarks of the 'molecool' engine hot paths, over particle counts and thread counts.
+
+usage: molecool_bench [--min-exp 3] [--max-exp 8] [--repeats 5] [--steps 10] [--filter name] [--output file]
+
+every benchmark is run for N = 10^min-exp ... 10^max-exp particles, and for 1, 2, 4, ... up to all threads
+results (min/median/mean seconds, and throughput per second) are written as JSON, by default to output/bench.json
+configurations that would not fit in (physical) memory are skipped
+*/
+
+#include "mcpch.h"
+#include "core/Simulation.h"
+#include "assets/observers/Trajectorizer.h"
+#include "assets/observers/Staticizer.h"
+#include "assets/observers/Momentizer.h"
+#include "assets/observers/Histogrammer.h"
+#include "assets/observers/Detectorizer.h"
+#include "Benchmark.h"
+
+#if defined(MC_PLATFORM_LINUX) || defined(MC_PLATFORM_MACOSX)
+#include <unistd.h>
+#endif
+
+namespace molecool {
+
+	// a simulation without a script, exposing the propagation loop
+	class BenchSimulation : public Simulation {
+	public:
+		BenchSimulation(long long n, int nForces) {
+			addParticles((int)n, ParticleId::CaF, Dist(PDF::gaussian, 0.0, 1.0), Dist(PDF::gaussian, 0.0, 1.0),
+				Dist(PDF::gaussian, 0.0, 1.0), Dist(PDF::gaussian, 0.0, 1.0), Dist(PDF::gaussian, 0.0, 1.0), Dist(PDF::gaussian, 0.0, 1.0));
+			for (int f = 0; f < nForces; ++f) {
+				double k = 1.0 + f;
+				addForce([k](const ParticleProxy& pp, double t) -> Force { return -k * pp.getPos(); });
+			}
+		}
+
+		// propagate over a number of timesteps (from scratch, i.e. including the initial force evaluation)
+		void propagateSteps(int steps) {
+			tStart = 0.0;
+			dt = 1e-3;
+			tEnd = (steps - 0.5) * dt;
+			propagate();
+		}
+	};
+
+	static void addGaussianParticles(Ensemble& ens, long long n) {
+		std::array< std::pair<PosDist, VelDist>, MC_DIMS > dists;
+		for (auto& d : dists) { d = std::make_pair(Dist(PDF::gaussian, 0.0, 1.0), Dist(PDF::gaussian, 0.0, 1.0)); }
+		ens.addParticles((int)n, ParticleId::CaF, dists);
+	}
+
+	// bytes, infinite (no limit) where unsupported
+	static double getPhysicalMemory() {
+#if defined(MC_PLATFORM_LINUX) || defined(MC_PLATFORM_MACOSX)
+		long pages = sysconf(_SC_PHYS_PAGES);
+		long pageSize = sysconf(_SC_PAGE_SIZE);
+		if (pages > 0 && pageSize > 0) { return (double)pages * (double)pageSize; }
+#endif
+		return std::numeric_limits<double>::infinity();
+	}
+
+	// 1, 2, 4, ... threads, always ending with all of them
+	static std::vector<int> getThreadCounts() {
+		int maxThreads = omp_get_num_procs();
+		std::vector<int> counts;
+		for (int t = 1; t < maxThreads; t *= 2) { counts.push_back(t); }
+		counts.push_back(maxThreads);
+		return counts;
+	}
+
+}
+
+
+int main(int argc, char** argv) {
+
+	using namespace molecool;
+
+	int minExp = 3, maxExp = 8, repeats = 5, steps = 10;
+	std::string filter, output = "output/bench.json";
+	for (int a = 1; a < argc; ++a) {
+		std::string arg = argv[a];
+		bool hasValue = a + 1 < argc;
+		if (arg == "--min-exp" && hasValue) { minExp = std::atoi(argv[++a]); }
+		else if (arg == "--max-exp" && hasValue) { maxExp = std::atoi(argv[++a]); }
+		else if (arg == "--repeats" && hasValue) { repeats = std::max(1, std::atoi(argv[++a])); }
+		else if (arg == "--steps" && hasValue) { steps = std::max(1, std::atoi(argv[++a])); }
+		else if (arg == "--filter" && hasValue) { filter = argv[++a]; }
+		else if (arg == "--output" && hasValue) { output = argv[++a]; }
+		else {
+			std::cerr << "usage: molecool_bench [--min-exp 3] [--max-exp 8] [--repeats 5] [--steps 10] [--filter name] [--output file]" << std::endl;
+			return 1;
+		}
+	}
+
+	Log::init();
+	Log::getCoreLogger()->set_level(spdlog::level::warn);		// keep engine tracing out of the timings
+	MC_INFO("MOLECOOL engine v{0} benchmarks", getEngineVersion());
+	omp_set_dynamic(0);
+
+	BenchRunner runner(repeats, filter);
+	std::vector<int> threadCounts = getThreadCounts();
+	double memory = getPhysicalMemory();
+	const double bytesPerParticle = 12 * MC_DIMS * sizeof(double);		// states, accelerations and temporaries, generously
+	const long long maxWriterParticles = 1000000;						// text outputs beyond this just measure the disk
+
+	for (int e = minExp; e <= maxExp; ++e) {
+		long long n = 1;
+		for (int k = 0; k < e; ++k) { n *= 10; }
+		if (n * bytesPerParticle > 0.8 * memory) {
+			MC_WARN("skipping N = {0}, not enough memory", n);
+			continue;
+		}
+		if (n > std::numeric_limits<int>::max() / MC_DIMS) {
+			MC_WARN("skipping N = {0}, particle indices are limited to int", n);
+			continue;
+		}
+
+		for (int nThreads : threadCounts) {
+
+			// ensemble creation: allocation, random sampling and transposition
+			runner.run("ensemble.addParticles", n, nThreads, (double)n, "particles", nullptr, [&]() {
+				Ensemble ens;
+				addGaussianParticles(ens, n);
+			});
+
+			// force evaluation, with an increasing number of force functions
+			for (int nForces : { 1, 4, 16 }) {
+				std::unique_ptr<BenchSimulation> sim;
+				state_type acc;
+				std::string name = "thruster.forces" + std::to_string(nForces);
+				runner.run(name, n, nThreads, (double)n, "particles", [&]() {
+					sim = std::make_unique<BenchSimulation>(n, nForces);
+					acc.assign(sim->ensemble.pos.size(), 0.0);
+				}, [&]() {
+					sim->thruster(sim->ensemble.pos, sim->ensemble.vel, acc, 0.0);
+				});
+			}
+
+			// full propagation steps (velocity-verlet stepper, forces and the watcher, without observers)
+			{
+				std::unique_ptr<BenchSimulation> sim;
+				runner.run("simulation.propagate", n, nThreads, (double)n * steps, "particle-steps", [&]() {
+					sim = std::make_unique<BenchSimulation>(n, 3);
+				}, [&]() {
+					sim->propagateSteps(steps);
+				});
+			}
+
+			// observers, a single deployment each
+			{
+				Ensemble ens;
+				std::vector<std::pair<std::string, ObserverPtr>> observers;
+				auto addObserver = [&](const std::string& name, std::function< ObserverPtr() > make) {
+					if (runner.isSelected(name)) { observers.emplace_back(name, make()); }
+				};
+				addObserver("observer.Trajectories", []() { return Trajectorizer::make(100); });
+				addObserver("observer.Statistics", []() { return Staticizer::make(); });
+				addObserver("observer.Moments", []() { return Momentizer::make(); });
+				addObserver("observer.Histogram", []() { return Histogrammer::make2("x", 100, -5, 5, "vx", 100, -5, 5); });
+				addObserver("observer.Detectors", []() { return Detectorizer::make("x", { -1.0, 0.0, 1.0 }); });
+				if (!observers.empty()) { addGaussianParticles(ens, n); }
+				for (auto& [name, observer] : observers) {
+					double t = 0.0;
+					runner.run(name, n, nThreads, (double)n, "particles", nullptr, [&]() {
+						(*observer)(ens, t);
+						t += 1e-3;
+					});
+				}
+			}
+
+			// output writers
+			if (n <= maxWriterParticles) {
+				Ensemble ens;
+				if (runner.isSelected("writer.ensemble") || runner.isSelected("writer.Histogram")) { addGaussianParticles(ens, n); }
+				runner.run("writer.ensemble", n, nThreads, (double)n, "particles", nullptr, [&]() {
+					ens.save("bench_ensemble");
+				});
+				runner.run("writer.Histogram", n, nThreads, (double)n, "particles", nullptr, [&]() {
+					Histogrammer histogrammer({ Histogrammer::makeAxis("x", 100, -5, 5), Histogrammer::makeAxis("y", 100, -5, 5), Histogrammer::makeAxis("z", 100, -5, 5) });
+					histogrammer(ens, 0.0);
+				});
+			}
+		}
+	}
+
+	runner.write(output);
+	MC_INFO("benchmark results written to {0}", output);
+
+	Log::shutdown();
+
+	return 0;
+}
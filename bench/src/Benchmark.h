@@ -0,0 +1,93 @@
+#pragma once
+
+#include "mcpch.h"
+#include <numeric>
+
+namespace molecool {
+
+	// result of one benchmark configuration (name, particle count, thread count)
+	struct BenchResult {
+		std::string name;
+		long long nParticles;
+		int nThreads;
+		int repeats;
+		double minTime;			// seconds per repeat
+		double medianTime;
+		double meanTime;
+		double items;			// work items per repeat, e.g. particles * steps
+		std::string unit;		// what an item is, e.g. "particle-steps"
+	};
+
+	using SetupFunction = std::function< void() >;
+	using BodyFunction = std::function< void() >;
+
+	// a minimal benchmark runner: every configuration is set up once, run once to warm up (first touch,
+	// lazy allocations), then timed over a fixed number of repeats, the median is the headline figure
+	// results are collected and written as a single JSON document
+	class BenchRunner {
+	public:
+		BenchRunner(int repeats, std::string filter)
+			: m_repeats(repeats), m_filter(filter)
+		{}
+
+		// true if the benchmark should run, i.e. its name contains the filter string
+		inline bool isSelected(const std::string& name) const {
+			return m_filter.empty() || name.find(m_filter) != std::string::npos;
+		}
+
+		void run(const std::string& name, long long nParticles, int nThreads, double items, const std::string& unit,
+			const SetupFunction& setup, const BodyFunction& body) {
+			if (!isSelected(name)) { return; }
+			omp_set_num_threads(nThreads);
+			if (setup) { setup(); }
+			body();		// warm up
+			std::vector<double> times;
+			for (int r = 0; r < m_repeats; ++r) {
+				auto start = std::chrono::steady_clock::now();
+				body();
+				auto stop = std::chrono::steady_clock::now();
+				times.push_back(std::chrono::duration<double>(stop - start).count());
+			}
+			std::vector<double> sorted = times;
+			std::sort(sorted.begin(), sorted.end());
+			double median = sorted.size() % 2 ? sorted[sorted.size() / 2] : 0.5 * (sorted[sorted.size() / 2 - 1] + sorted[sorted.size() / 2]);
+			double mean = std::accumulate(times.begin(), times.end(), 0.0) / times.size();
+			results.push_back(BenchResult{ name, nParticles, nThreads, m_repeats, sorted.front(), median, mean, items, unit });
+			MC_INFO("{0:<28} N = {1:>10}  threads = {2:>3}  median = {3:.6f} s  ({4:.4g} {5}/s)", name, nParticles, nThreads, median, items / median, unit);
+		}
+
+		void write(const std::string& filename) const {
+			std::ofstream outputStream(filename);
+			if (!outputStream.is_open()) {
+				MC_ERROR("Benchmark could not open output file {0}", filename);
+				return;
+			}
+			auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+			outputStream << std::setprecision(9);
+			outputStream << "{\"engine\":\"" << getEngineVersion() << "\",\"timestamp\":" << (long long)now;
+#ifdef MC_RELEASE
+			outputStream << ",\"configuration\":\"Release\"";
+#else
+			outputStream << ",\"configuration\":\"Debug\"";
+#endif
+			outputStream << ",\"maxThreads\":" << omp_get_num_procs() << ",\"repeats\":" << m_repeats << ",\"results\":[";
+			for (size_t k = 0; k < results.size(); ++k) {
+				const BenchResult& r = results.at(k);
+				if (k > 0) { outputStream << ","; }
+				outputStream << "{\"name\":\"" << r.name << "\",\"particles\":" << r.nParticles << ",\"threads\":" << r.nThreads;
+				outputStream << ",\"min\":" << r.minTime << ",\"median\":" << r.medianTime << ",\"mean\":" << r.meanTime;
+				outputStream << ",\"items\":" << r.items << ",\"unit\":\"" << r.unit << "\",\"throughput\":" << r.items / r.medianTime << "}";
+			}
+			outputStream << "]}";
+			outputStream.flush();
+			outputStream.close();
+		}
+
+		std::vector<BenchResult> results;
+
+	private:
+		int m_repeats;
+		std::string m_filter;
+	};
+
+}
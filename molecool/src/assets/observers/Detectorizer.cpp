@@ -0,0 +1,271 @@
+#include "mcpch.h"
+#include "Detectorizer.h"
+
+namespace molecool {
+
+	int Detectorizer::s_instance = 0;
+
+	Detectorizer::Detectorizer()
+		: m_instance(s_instance)
+	{
+		MC_CORE_TRACE("Creating detectorizer");
+		s_instance++;
+	}
+
+	int Detectorizer::addPlane(std::string name, Vector normal, double offset, double apertureRadius) {
+		return addDetector(name, Surface::plane, normal, Position(), offset, apertureRadius);
+	}
+
+	int Detectorizer::addSphere(std::string name, Position center, double radius) {
+		return addDetector(name, Surface::sphere, Vector(), center, radius, 0.0);
+	}
+
+	int Detectorizer::addCylinder(std::string name, Position origin, Vector direction, double radius) {
+		return addDetector(name, Surface::cylinder, direction, origin, radius, 0.0);
+	}
+
+	int Detectorizer::addDetector(std::string name, Surface surface, Vector direction, Position origin, double level, double apertureRadius) {
+		double norm = std::sqrt(direction.x * direction.x + direction.y * direction.y + direction.z * direction.z);
+		if (surface != Surface::sphere) {
+			if (norm == 0.0) {
+				MC_CORE_ERROR("Detector '{0}' has no orientation, ignoring it", name);
+				return -1;
+			}
+			direction /= norm;
+		}
+
+		// detectors sharing shape, orientation and origin belong to the same family
+		auto same = [&](const Family& f) {
+			return f.surface == surface && f.direction.x == direction.x && f.direction.y == direction.y && f.direction.z == direction.z
+				&& f.origin.x == origin.x && f.origin.y == origin.y && f.origin.z == origin.z;
+		};
+		auto fit = std::find_if(families.begin(), families.end(), same);
+		if (fit == families.end()) {
+			families.push_back(Family{ surface, direction, origin, {}, {} });
+			fit = families.end() - 1;
+		}
+		int id = (int)detectors.size();
+		auto pos = std::upper_bound(fit->levels.begin(), fit->levels.end(), level);
+		fit->detectors.insert(fit->detectors.begin() + (pos - fit->levels.begin()), id);
+		fit->levels.insert(pos, level);
+		detectors.push_back(Detector{ name, (int)(fit - families.begin()), level, apertureRadius });
+		MC_CORE_TRACE("Adding {0} detector '{1}'", surfaceToName(surface), name);
+		return id;
+	}
+
+	inline double Detectorizer::getLevel(const Family& f, const double* x) {
+		switch (f.surface) {
+		case Surface::plane:
+			return f.direction.x * x[0] + f.direction.y * x[1] + f.direction.z * x[2];
+		case Surface::sphere:
+		{
+			double dx = x[0] - f.origin.x, dy = x[1] - f.origin.y, dz = x[2] - f.origin.z;
+			return std::sqrt(dx * dx + dy * dy + dz * dz);
+		}
+		case Surface::cylinder:
+		{
+			double dx = x[0] - f.origin.x, dy = x[1] - f.origin.y, dz = x[2] - f.origin.z;
+			double along = f.direction.x * dx + f.direction.y * dy + f.direction.z * dz;
+			return std::sqrt(std::max(0.0, dx * dx + dy * dy + dz * dz - along * along));
+		}
+		default:
+			return 0.0;
+		}
+	}
+
+	void Detectorizer::operator()(const Ensemble& ens, double t) {
+		MC_PROFILE_FUNCTION();
+		int nParticles = (int)ens.pos.size() / MC_DIMS;
+
+		// test the segments travelled since the previous deployment, the ensemble is that at the end of the step
+		t += m_dt;
+		if (m_primed && (int)m_prevActive.size() == nParticles && !families.empty()) {
+			m_threadEvents.resize(omp_get_max_threads());
+			double t0 = m_prevT;
+			double dt = t - m_prevT;
+			#pragma omp parallel
+			{
+				std::vector<Event>& buffer = m_threadEvents[omp_get_thread_num()];
+				buffer.clear();
+				#pragma omp for schedule(static)
+				for (int i = 0; i < nParticles; ++i) {
+					// a slot refilled by a source since the previous deployment holds a different particle
+					if (!m_prevActive[i] || m_prevGeneration[i] != ens.getSlotGeneration(i)) { continue; }
+					int j = MC_DIMS * i;
+					const double* x0 = &m_prevPos[j];
+					const double* x1 = &ens.pos[j];
+					for (const Family& f : families) {
+						double s0 = getLevel(f, x0);
+						double s1 = getLevel(f, x1);
+						if (s0 == s1) { continue; }
+						// detectors with levels in (min(s0, s1), max(s0, s1)] were crossed
+						auto first = std::upper_bound(f.levels.begin(), f.levels.end(), std::min(s0, s1));
+						auto last = std::upper_bound(first, f.levels.end(), std::max(s0, s1));
+						for (auto it = first; it != last; ++it) {
+							int id = f.detectors[it - f.levels.begin()];
+							double frac = (*it - s0) / (s1 - s0);
+							const double* v0 = &m_prevVel[j];
+							const double* v1 = &ens.vel[j];
+							Position xc(x0[0] + frac * (x1[0] - x0[0]), x0[1] + frac * (x1[1] - x0[1]), x0[2] + frac * (x1[2] - x0[2]));
+							double r = detectors[id].apertureRadius;
+							if (r > 0.0) {
+								double along = f.direction.x * xc.x + f.direction.y * xc.y + f.direction.z * xc.z;
+								if (xc.x * xc.x + xc.y * xc.y + xc.z * xc.z - along * along > r * r) { continue; }
+							}
+							Velocity vc(v0[0] + frac * (v1[0] - v0[0]), v0[1] + frac * (v1[1] - v0[1]), v0[2] + frac * (v1[2] - v0[2]));
+							buffer.push_back(Event{ id, m_firstParticle + i, s1 > s0 ? 1 : -1, t0 + frac * dt, xc, vc });
+						}
+					}
+				}
+			}
+			for (const auto& buffer : m_threadEvents) {
+				events.insert(events.end(), buffer.begin(), buffer.end());
+			}
+		}
+
+		remember(ens, t);
+	}
+
+	void Detectorizer::start(const Ensemble& ens, double t, double dt) {
+		m_dt = dt;
+		remember(ens, t);
+	}
+
+	void Detectorizer::remember(const Ensemble& ens, double t) {
+		int nParticles = (int)ens.pos.size() / MC_DIMS;
+		m_prevPos.resize(ens.pos.size());
+		m_prevVel.resize(ens.vel.size());
+		m_prevActive.resize(nParticles);
+		m_prevGeneration.resize(nParticles);
+		#pragma omp parallel for schedule(static)
+		for (int i = 0; i < nParticles; ++i) {
+			int j = MC_DIMS * i;
+			for (int d = 0; d < MC_DIMS; ++d) {
+				m_prevPos[j + d] = ens.pos[j + d];
+				m_prevVel[j + d] = ens.vel[j + d];
+			}
+			m_prevActive[i] = ens.isParticleActive(i);
+			m_prevGeneration[i] = ens.getSlotGeneration(i);
+		}
+		m_prevT = t;
+		m_primed = true;
+	}
+
+	ObserverPtr Detectorizer::makeWithAperture(std::string axis, std::vector<double> positions, double apertureRadius) {
+		Vector normal;
+		if (axis == "x") { normal = Vector(1, 0, 0); }
+		else if (axis == "y") { normal = Vector(0, 1, 0); }
+		else if (axis == "z") { normal = Vector(0, 0, 1); }
+		else {
+			MC_CORE_WARN("detector axis {0} not recognized, using z", axis);
+			normal = Vector(0, 0, 1);
+			axis = "z";
+		}
+		auto detectorizer = std::make_shared<Detectorizer>();
+		for (double p : positions) {
+			std::stringstream name;
+			name << axis << "=" << p;
+			detectorizer->addPlane(name.str(), normal, p, apertureRadius);
+		}
+		return detectorizer;
+	}
+
+	std::string Detectorizer::surfaceToName(Surface s) {
+		switch (s) {
+		case Surface::plane: return "plane";
+		case Surface::sphere: return "sphere";
+		case Surface::cylinder: return "cylinder";
+		default: return "unknown";
+		}
+	}
+
+	void Detectorizer::reset() {
+		events.clear();
+		m_primed = false;
+	}
+
+	// the particles of a new batch have no previous states, their segments start at the start of the batch
+	void Detectorizer::beginBatch(long long batch, long long firstParticle) {
+		m_firstParticle = firstParticle;
+		m_primed = false;
+	}
+
+	void Detectorizer::saveState(BinaryWriter& out) const {
+		out.write(events);
+		out.write(m_prevPos);
+		out.write(m_prevVel);
+		out.write(m_prevActive);
+		out.write(m_prevGeneration);
+		out.write(m_prevT);
+		out.write(m_dt);
+		out.write(m_primed);
+	}
+
+	void Detectorizer::loadState(BinaryReader& in) {
+		in.read(events);
+		in.read(m_prevPos);
+		in.read(m_prevVel);
+		in.read(m_prevActive);
+		in.read(m_prevGeneration);
+		in.read(m_prevT);
+		in.read(m_dt);
+		in.read(m_primed);
+	}
+
+	Detectorizer::~Detectorizer() {
+		MC_PROFILE_FUNCTION();
+		MC_CORE_TRACE("Destroying detectorizer");
+		if (isWrittenOnDestruction()) { writeResults("output"); }
+	}
+
+	Observer::Summary Detectorizer::getSummary() {
+		std::vector<long long> counts(detectors.size(), 0);
+		std::vector<double> times(detectors.size(), 0.0);
+		for (const Event& ev : events) {
+			counts[ev.detector]++;
+			times[ev.detector] += ev.t;
+		}
+		Summary summary;
+		for (size_t d = 0; d < detectors.size(); ++d) {
+			summary[detectors[d].name] = (double)counts[d];
+			summary[detectors[d].name + ".t"] = counts[d] > 0 ? times[d] / counts[d] : 0.0;
+		}
+		return summary;
+	}
+
+	void Detectorizer::writeResults(const std::string& dir) {
+		MC_PROFILE_FUNCTION();
+		std::ofstream outputStream;
+		std::string filename = dir + "/detections";
+		if (m_instance > 0) { filename += std::to_string(m_instance); }
+		filename += ".json";
+		outputStream.open(filename);
+		if (!outputStream.is_open())
+		{
+			if (Log::getCoreLogger()) // Edge case: destructor might be before Log::init()
+			{
+				MC_CORE_ERROR("Detectorizer could not open output file.");
+			}
+			exit(-1);
+		}
+		outputStream << std::fixed << std::setprecision(6);
+		outputStream << "{\"detectors\":[";
+		for (size_t d = 0; d < detectors.size(); ++d) {
+			const Detector& det = detectors.at(d);
+			const Family& f = families.at(det.family);
+			if (d > 0) { outputStream << ","; }
+			outputStream << "{\"name\":\"" << det.name << "\",\"surface\":\"" << surfaceToName(f.surface) << "\",\"level\":" << det.level;
+			outputStream << ",\"direction\":[" << f.direction << "],\"origin\":[" << f.origin << "],\"aperture\":" << det.apertureRadius << "}";
+		}
+		// compact event table, one row per crossing: [detector, particle, direction, t, x, y, z, vx, vy, vz]
+		outputStream << "],\"events\":[";
+		for (size_t e = 0; e < events.size(); ++e) {
+			const Event& ev = events.at(e);
+			if (e > 0) { outputStream << ","; }
+			outputStream << "[" << ev.detector << "," << ev.particle << "," << ev.direction << "," << ev.t << "," << ev.pos << "," << ev.vel << "]";
+		}
+		outputStream << "]}";
+		outputStream.flush();
+		outputStream.close();
+	}
+}
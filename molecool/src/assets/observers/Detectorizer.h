@@ -0,0 +1,103 @@
+#pragma once
+
+#include "core/Watcher.h"
+#include "core/Vector.h"
+
+namespace molecool {
+
+    // virtual detectors that record every crossing of a surface by a particle, e.g. "when and where did
+    // each molecule cross z = L?"  Each particle's straight segment between two deployments (the first from the
+    // initial ensemble, see Observer::start) is tested, and the crossing time and phase-space point are interpolated
+    // linearly along it
+    // detectors of the same shape and orientation (e.g. many planes z = L1, L2, ...) form a family, and are
+    // stored as a sorted list of levels of a single scalar function of position, so a particle is tested against
+    // all detectors of a family with one evaluation and a binary search: the cost scales with the number of
+    // families and of crossing events, not with the number of detectors
+    class Detectorizer : public Observer
+    {
+	public:
+
+		enum class Surface {
+			plane,			// level = normal . x
+			sphere,			// level = |x - origin|
+			cylinder		// level = distance of x from the line through origin along direction
+		};
+
+		struct Event {
+			int detector;
+			long long particle;
+			int direction;		// +1 if the level increases across the crossing, -1 otherwise
+			double t;
+			Position pos;
+			Velocity vel;
+		};
+
+		Detectorizer();
+		~Detectorizer();
+		void operator()(const Ensemble& ens, double t) override;
+		void saveState(BinaryWriter& out) const override;
+		void loadState(BinaryReader& in) override;
+		void writeResults(const std::string& dir) override;
+		void reset() override;
+		void beginBatch(long long batch, long long firstParticle) override;
+		void start(const Ensemble& ens, double t, double dt) override;
+		Summary getSummary() override;		// per detector name: the number of crossings, and their mean time (name.t)
+
+		// add detectors, returning their ids, planes may have a circular aperture centred on the normal through the origin
+		int addPlane(std::string name, Vector normal, double offset, double apertureRadius = 0.0);
+		int addSphere(std::string name, Position center, double radius);
+		int addCylinder(std::string name, Position origin, Vector direction, double radius);
+
+		inline const std::vector<Event>& getEvents() const { return events; }
+
+		// factory-like functions: planes perpendicular to the named axis ("x", "y" or "z") at the given positions
+		static ObserverPtr make(std::string axis, std::vector<double> positions) {
+			return makeWithAperture(axis, positions, 0.0);
+		}
+		static ObserverPtr makeWithAperture(std::string axis, std::vector<double> positions, double apertureRadius);
+
+	private:
+
+		struct Family {
+			Surface surface;
+			Vector direction;
+			Position origin;
+			std::vector<double> levels;		// sorted
+			std::vector<int> detectors;		// detector ids, in the same order as levels
+		};
+
+		struct Detector {
+			std::string name;
+			int family;
+			double level;
+			double apertureRadius;
+		};
+
+		std::vector<Family> families;
+		std::vector<Detector> detectors;
+		std::vector<Event> events;
+		std::vector<std::vector<Event>> m_threadEvents;		// per-thread event buffers, appended in thread order
+
+		// particle states at the previous deployment (or the start), at time m_prevT
+		state_type m_prevPos, m_prevVel;
+		std::vector<char> m_prevActive;
+		std::vector<uint32_t> m_prevGeneration;
+		double m_prevT = 0.0;
+		double m_dt = 0.0;					// a deployment labelled t sees the ensemble at t + m_dt
+		bool m_primed = false;
+		long long m_firstParticle = 0;		// index of the ensemble's first particle in an out-of-core run
+
+		int m_instance = 0;
+		static int s_instance;
+
+		int addDetector(std::string name, Surface surface, Vector direction, Position origin, double level, double apertureRadius);
+		static inline double getLevel(const Family& f, const double* x);
+
+		// remember the states as the start of the next segments
+		void remember(const Ensemble& ens, double t);
+		static std::string surfaceToName(Surface s);
+
+    };
+}
+
+
@@ -0,0 +1,242 @@
+#include "mcpch.h"
+#include "Histogrammer.h"
+
+namespace molecool {
+
+	int Histogrammer::s_instance = 0;
+
+	Histogrammer::Histogrammer(const std::vector<Axis>& axes)
+		: m_axes(axes), m_instance(s_instance)
+	{
+		MC_CORE_TRACE("Creating {0}D histogrammer", m_axes.size());
+		for (auto& axis : m_axes) {
+			if (axis.nBins < 1) {
+				MC_CORE_WARN("Histogram axis with {0} bins, using 1 bin", axis.nBins);
+				axis.nBins = 1;
+			}
+			m_nBins *= axis.nBins;
+		}
+		s_instance++;
+	}
+
+	inline double Histogrammer::getQuantity(Quantity q, const Ensemble& ens, int j, double t) {
+		switch (q) {
+		case Quantity::x:
+			return ens.pos[j];
+		case Quantity::y:
+			return ens.pos[j + 1];
+		case Quantity::z:
+			return ens.pos[j + 2];
+		case Quantity::vx:
+			return ens.vel[j];
+		case Quantity::vy:
+			return ens.vel[j + 1];
+		case Quantity::vz:
+			return ens.vel[j + 2];
+		case Quantity::r:
+			return std::sqrt(ens.pos[j] * ens.pos[j] + ens.pos[j + 1] * ens.pos[j + 1] + ens.pos[j + 2] * ens.pos[j + 2]);
+		case Quantity::speed:
+			return std::sqrt(ens.vel[j] * ens.vel[j] + ens.vel[j + 1] * ens.vel[j + 1] + ens.vel[j + 2] * ens.vel[j + 2]);
+		case Quantity::t:
+			return t;
+		default:
+			return 0.0;
+		}
+	}
+
+	void Histogrammer::operator()(const Ensemble& ens, double t) {
+		MC_PROFILE_FUNCTION();
+		int nParticles = (int)ens.pos.size() / MC_DIMS;
+		int nThreads = omp_get_max_threads();
+		if ((int)m_threadCounts.size() < nThreads) {
+			m_threadCounts.resize(nThreads);
+			m_threadOutliers.resize(nThreads, 0);
+		}
+
+		// bin index = (value - min) * scale, precomputed per axis
+		int nAxes = (int)m_axes.size();
+		std::vector<double> scales(nAxes);
+		for (int a = 0; a < nAxes; ++a) {
+			scales[a] = m_axes[a].nBins / (m_axes[a].max - m_axes[a].min);
+		}
+
+		#pragma omp parallel
+		{
+			int threadId = omp_get_thread_num();
+			std::vector<uint64_t>& counts = m_threadCounts[threadId];
+			if (counts.empty()) { counts.assign(m_nBins, 0); }	// first touch by the owning thread
+			uint64_t outliers = 0;
+			#pragma omp for schedule(static)
+			for (int i = 0; i < nParticles; ++i) {
+				if (!ens.isParticleActive(i)) { continue; }
+				int j = MC_DIMS * i;
+				size_t bin = 0;
+				bool inside = true;
+				for (int a = 0; a < nAxes; ++a) {
+					const Axis& axis = m_axes[a];
+					double f = (getQuantity(axis.quantity, ens, j, t) - axis.min) * scales[a];
+					if (!(f >= 0.0 && f < axis.nBins)) { inside = false; break; }	// also rejects NaN
+					bin = bin * axis.nBins + (size_t)f;
+				}
+				if (inside) { counts[bin]++; }
+				else { outliers++; }
+			}
+			m_threadOutliers[threadId] += outliers;
+		}
+		m_merged = false;
+	}
+
+	const std::vector<uint64_t>& Histogrammer::getCounts() {
+		if (!m_merged) { merge(); }
+		return m_counts;
+	}
+
+	void Histogrammer::merge() {
+		MC_PROFILE_FUNCTION();
+		m_counts.assign(m_nBins, 0);
+		long long nBins = (long long)m_nBins;
+		#pragma omp parallel for schedule(static)
+		for (long long b = 0; b < nBins; ++b) {
+			uint64_t sum = 0;
+			for (const auto& counts : m_threadCounts) {
+				if (!counts.empty()) { sum += counts[b]; }
+			}
+			m_counts[b] = sum;
+		}
+		m_outliers = 0;
+		for (auto outliers : m_threadOutliers) { m_outliers += outliers; }
+		m_merged = true;
+	}
+
+	// write counts in the numpy .npy (version 1.0) format, readable with numpy.load()
+	void Histogrammer::writeNpy(const std::string& filename) {
+		std::ofstream outputStream(filename, std::ios::binary);
+		if (!outputStream.is_open())
+		{
+			if (Log::getCoreLogger()) // Edge case: destructor might be before Log::init()
+			{
+				MC_CORE_ERROR("Histogrammer could not open output file.");
+			}
+			exit(-1);
+		}
+		std::stringstream shape;
+		for (const auto& axis : m_axes) { shape << axis.nBins << ", "; }
+		std::string header = "{'descr': '<u8', 'fortran_order': False, 'shape': (" + shape.str() + "), }";
+		// magic string (6) + version (2) + header length (2) + header must be a multiple of 64 bytes, ending in a newline
+		size_t total = 10 + header.size() + 1;
+		header += std::string((64 - total % 64) % 64, ' ') + "\n";
+		uint16_t headerLength = (uint16_t)header.size();
+		outputStream.write("\x93NUMPY\x01\x00", 8);
+		char lengthBytes[2] = { (char)(headerLength & 0xff), (char)(headerLength >> 8) };
+		outputStream.write(lengthBytes, 2);
+		outputStream << header;
+		outputStream.write((const char*)m_counts.data(), m_counts.size() * sizeof(uint64_t));	// assumes little-endian host
+		outputStream.flush();
+		outputStream.close();
+	}
+
+	void Histogrammer::reset() {
+		for (auto& counts : m_threadCounts) { std::fill(counts.begin(), counts.end(), 0); }
+		std::fill(m_threadOutliers.begin(), m_threadOutliers.end(), 0);
+		m_merged = false;
+	}
+
+	// the merged histogram is saved, and restored as the contribution of the first thread
+	void Histogrammer::saveState(BinaryWriter& out) const {
+		std::vector<uint64_t> counts(m_nBins, 0);
+		uint64_t outliers = 0;
+		for (size_t k = 0; k < m_threadCounts.size(); ++k) {
+			const auto& threadCounts = m_threadCounts[k];
+			for (size_t b = 0; b < threadCounts.size(); ++b) { counts[b] += threadCounts[b]; }
+			outliers += m_threadOutliers[k];
+		}
+		out.write(counts);
+		out.write(outliers);
+	}
+
+	void Histogrammer::loadState(BinaryReader& in) {
+		in.read(m_counts);
+		in.read(m_outliers);
+		m_threadCounts.assign(1, m_counts);
+		m_threadOutliers.assign(1, m_outliers);
+		m_merged = true;
+	}
+
+	Histogrammer::~Histogrammer() {
+		MC_PROFILE_FUNCTION();
+		MC_CORE_TRACE("Destroying histogrammer");
+		if (isWrittenOnDestruction()) { writeResults("output"); }
+	}
+
+	Observer::Summary Histogrammer::getSummary() {
+		uint64_t total = 0;
+		for (auto count : getCounts()) { total += count; }
+		Summary summary;
+		summary["counts"] = (double)total;
+		summary["outliers"] = (double)m_outliers;
+		return summary;
+	}
+
+	void Histogrammer::writeResults(const std::string& dir) {
+		MC_PROFILE_FUNCTION();
+		std::string name = "histogram";
+		if (m_instance > 0) { name += std::to_string(m_instance); }
+		std::string filename = dir + "/" + name;
+		getCounts();
+		writeNpy(filename + ".npy");
+
+		// axis descriptions accompany the binary counts
+		std::ofstream outputStream;
+		outputStream.open(filename + ".json");
+		if (!outputStream.is_open())
+		{
+			if (Log::getCoreLogger()) // Edge case: destructor might be before Log::init()
+			{
+				MC_CORE_ERROR("Histogrammer could not open output file.");
+			}
+			exit(-1);
+		}
+		outputStream << std::fixed << std::setprecision(6);
+		outputStream << "{\"histogram\":{\"counts\":\"" << name << ".npy\",\"outliers\":" << m_outliers << ",\"axes\":[";
+		for (size_t a = 0; a < m_axes.size(); ++a) {
+			const Axis& axis = m_axes.at(a);
+			if (a > 0) { outputStream << ","; }
+			outputStream << "{\"quantity\":\"" << quantityToName(axis.quantity) << "\",\"bins\":" << axis.nBins;
+			outputStream << ",\"min\":" << axis.min << ",\"max\":" << axis.max << "}";
+		}
+		outputStream << "]}}";
+		outputStream.flush();
+		outputStream.close();
+	}
+
+	Histogrammer::Quantity Histogrammer::nameToQuantity(std::string name) {
+		if (name == "x") { return Quantity::x; }
+		else if (name == "y") { return Quantity::y; }
+		else if (name == "z") { return Quantity::z; }
+		else if (name == "vx") { return Quantity::vx; }
+		else if (name == "vy") { return Quantity::vy; }
+		else if (name == "vz") { return Quantity::vz; }
+		else if (name == "r") { return Quantity::r; }
+		else if (name == "speed") { return Quantity::speed; }
+		else if (name == "t") { return Quantity::t; }
+		else {
+			MC_CORE_WARN("histogram quantity {0} not recognized", name);
+			return Quantity::x;
+		}
+	}
+
+	std::string Histogrammer::quantityToName(Quantity q) {
+		switch (q) {
+		case Quantity::x: return "x";
+		case Quantity::y: return "y";
+		case Quantity::z: return "z";
+		case Quantity::vx: return "vx";
+		case Quantity::vy: return "vy";
+		case Quantity::vz: return "vz";
+		case Quantity::r: return "r";
+		case Quantity::speed: return "speed";
+		case Quantity::t: return "t";
+		default: return "unknown";
+		}
+	}
+}
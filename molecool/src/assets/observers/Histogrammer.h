@@ -0,0 +1,72 @@
+#pragma once
+
+#include "core/Watcher.h"
+
+namespace molecool {
+
+    // bins ensemble quantities into a 1D, 2D or 3D histogram, accumulated over all deployments
+    // e.g. a time-of-flight profile (t), a phase-space portrait (x, vx) or a final-position image (x, y)
+    // each thread fills its own private copy of the histogram, the copies are only merged when the
+    // result is requested, so there is no contention between threads while sampling
+    class Histogrammer : public Observer
+    {
+	public:
+
+		// quantities that can be binned
+		enum class Quantity { x, y, z, vx, vy, vz, r, speed, t };
+
+		struct Axis {
+			Quantity quantity;
+			int nBins;
+			double min, max;
+		};
+
+		Histogrammer(const std::vector<Axis>& axes);
+		~Histogrammer();
+		void operator()(const Ensemble& ens, double t) override;
+		void saveState(BinaryWriter& out) const override;
+		void loadState(BinaryReader& in) override;
+		void writeResults(const std::string& dir) override;
+		void reset() override;
+		Summary getSummary() override;		// the total counts and outliers
+
+		// merged bin counts, row-major with the first axis slowest
+		const std::vector<uint64_t>& getCounts();
+
+		// factory-like functions for 1D, 2D and 3D histograms, axes given as (quantity name, bins, min, max)
+		static ObserverPtr make1(std::string q1, int n1, double min1, double max1) {
+			return std::make_shared<Histogrammer>(std::vector<Axis>{ makeAxis(q1, n1, min1, max1) });
+		}
+		static ObserverPtr make2(std::string q1, int n1, double min1, double max1, std::string q2, int n2, double min2, double max2) {
+			return std::make_shared<Histogrammer>(std::vector<Axis>{ makeAxis(q1, n1, min1, max1), makeAxis(q2, n2, min2, max2) });
+		}
+		static ObserverPtr make3(std::string q1, int n1, double min1, double max1, std::string q2, int n2, double min2, double max2,
+			std::string q3, int n3, double min3, double max3) {
+			return std::make_shared<Histogrammer>(std::vector<Axis>{ makeAxis(q1, n1, min1, max1), makeAxis(q2, n2, min2, max2), makeAxis(q3, n3, min3, max3) });
+		}
+
+		static Axis makeAxis(std::string name, int nBins, double min, double max) {
+			return Axis{ nameToQuantity(name), nBins, min, max };
+		}
+		static Quantity nameToQuantity(std::string name);
+		static std::string quantityToName(Quantity q);
+
+	private:
+		std::vector<Axis> m_axes;
+		size_t m_nBins = 1;										// total number of bins
+		std::vector<std::vector<uint64_t>> m_threadCounts;		// per-thread private histograms
+		std::vector<uint64_t> m_threadOutliers;					// per-thread count of samples outside the histogram range
+		std::vector<uint64_t> m_counts;							// merged histogram
+		uint64_t m_outliers = 0;
+		bool m_merged = true;
+		int m_instance = 0;
+		static int s_instance;
+
+		void merge();
+		static inline double getQuantity(Quantity q, const Ensemble& ens, int j, double t);
+		void writeNpy(const std::string& filename);
+
+    };
+}
+
+
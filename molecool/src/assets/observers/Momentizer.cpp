@@ -0,0 +1,246 @@
+#include "mcpch.h"
+#include "Momentizer.h"
+
+namespace molecool {
+
+	int Momentizer::s_instance = 0;
+
+	static constexpr double boltzmannConstant = 1.380649e-23;	// J/K
+	static constexpr double pi = 3.14159265358979323846;
+
+	// weighted update of the running means and co-moments (West, 1979)
+	// note: only the upper triangle of the co-moment matrix is accumulated
+	void Momentizer::Moments::add(const double* q, double w, double m) {
+		if (w <= 0.0) { return; }
+		weight += w;
+		massWeight += w * m;
+		double r = w / weight;
+		double delta[nCoords];
+		for (int i = 0; i < nCoords; ++i) {
+			delta[i] = q[i] - mean[i];
+			mean[i] += r * delta[i];
+		}
+		double c = w * (1.0 - r);
+		for (int i = 0; i < nCoords; ++i) {
+			for (int j = i; j < nCoords; ++j) {
+				comoment[i * nCoords + j] += c * delta[i] * delta[j];
+			}
+		}
+	}
+
+	// pairwise combination of two partial results (Chan, Golub & LeVeque, 1979)
+	void Momentizer::Moments::merge(const Moments& other) {
+		if (other.weight <= 0.0) { return; }
+		if (weight <= 0.0) { *this = other; return; }
+		double total = weight + other.weight;
+		double f = weight * other.weight / total;
+		double delta[nCoords];
+		for (int i = 0; i < nCoords; ++i) {
+			delta[i] = other.mean[i] - mean[i];
+			mean[i] += delta[i] * other.weight / total;
+		}
+		for (int i = 0; i < nCoords; ++i) {
+			for (int j = i; j < nCoords; ++j) {
+				comoment[i * nCoords + j] += other.comoment[i * nCoords + j] + f * delta[i] * delta[j];
+			}
+		}
+		weight = total;
+		massWeight += other.massWeight;
+	}
+
+	Momentizer::Momentizer(WeightFunction wf, double speciesMass)
+		: m_weight(wf), m_speciesMass(speciesMass), m_instance(s_instance)
+	{
+		MC_CORE_TRACE("Creating momentizer");
+		s_instance++;
+	}
+
+	void Momentizer::operator()(const Ensemble& ens, double t) {
+		MC_PROFILE_FUNCTION();
+		int nParticles = (int)ens.pos.size() / MC_DIMS;
+		m_partials.assign(omp_get_max_threads(), Moments());
+		#pragma omp parallel
+		{
+			Moments local;		// accumulate on the thread's own stack to avoid false sharing
+			double q[nCoords];
+			#pragma omp for schedule(static)
+			for (int i = 0; i < nParticles; ++i) {
+				if (!ens.isParticleActive(i)) { continue; }
+				int j = MC_DIMS * i;
+				for (int d = 0; d < MC_DIMS; ++d) {
+					q[d] = ens.pos[j + d];
+					q[MC_DIMS + d] = ens.vel[j + d];
+				}
+				double w = m_weight ? m_weight(ParticleProxy(ens, i)) : 1.0;
+				local.add(q, w, ens.getParticleMass(i));
+			}
+			m_partials[omp_get_thread_num()] = local;
+		}
+		// merge partials in thread order so results don't depend on thread timing
+		Moments total;
+		for (const auto& partial : m_partials) {
+			total.merge(partial);
+		}
+		// batches are merged by sample time (a batch may stop early, or skip times), the times of a batch increase, so
+		// the search starts after its previous sample
+		double tolerance = 1e-9 * std::max(1.0, std::abs(t));
+		while (m_sample < samples.size() && samples[m_sample].t < t - tolerance) { m_sample++; }
+		if (m_sample < samples.size() && std::abs(samples[m_sample].t - t) <= tolerance) {
+			samples[m_sample].population += ens.getPopulation();
+			samples[m_sample].moments.merge(total);
+		}
+		else {
+			samples.insert(samples.begin() + m_sample, { t, ens.getPopulation(), total });
+		}
+		m_sample++;
+	}
+
+	void Momentizer::reset() {
+		samples.clear();
+		m_sample = 0;
+	}
+
+	void Momentizer::beginBatch(long long batch, long long firstParticle) {
+		m_sample = 0;
+	}
+
+	double Momentizer::determinant(std::array<double, nCoords * nCoords> a) {
+		// fill the lower triangle from the accumulated upper triangle
+		for (int i = 0; i < nCoords; ++i) {
+			for (int j = 0; j < i; ++j) {
+				a[i * nCoords + j] = a[j * nCoords + i];
+			}
+		}
+		// gaussian elimination with partial pivoting
+		double det = 1.0;
+		for (int k = 0; k < nCoords; ++k) {
+			int pivot = k;
+			for (int i = k + 1; i < nCoords; ++i) {
+				if (std::abs(a[i * nCoords + k]) > std::abs(a[pivot * nCoords + k])) { pivot = i; }
+			}
+			if (a[pivot * nCoords + k] == 0.0) { return 0.0; }
+			if (pivot != k) {
+				for (int j = 0; j < nCoords; ++j) { std::swap(a[k * nCoords + j], a[pivot * nCoords + j]); }
+				det = -det;
+			}
+			det *= a[k * nCoords + k];
+			for (int i = k + 1; i < nCoords; ++i) {
+				double f = a[i * nCoords + k] / a[k * nCoords + k];
+				for (int j = k; j < nCoords; ++j) { a[i * nCoords + j] -= f * a[k * nCoords + j]; }
+			}
+		}
+		return det;
+	}
+
+	double Momentizer::getPeakDensity(const Moments& m) {
+		if (!(m.weight > 0.0)) { return 0.0; }
+		std::array<double, nCoords * nCoords> cov;
+		for (int i = 0; i < nCoords * nCoords; ++i) { cov[i] = m.comoment[i] / m.weight; }
+		double volume = std::pow(2.0 * pi, MC_DIMS) * std::sqrt(std::max(0.0, determinant(cov)));
+		return volume > 0.0 ? m.weight / volume : 0.0;
+	}
+
+	void Momentizer::saveState(BinaryWriter& out) const {
+		out.write(samples);
+	}
+
+	void Momentizer::loadState(BinaryReader& in) {
+		in.read(samples);
+		m_sample = samples.size();
+	}
+
+	Momentizer::~Momentizer() {
+		MC_PROFILE_FUNCTION();
+		MC_CORE_TRACE("Destroying momentizer");
+		if (isWrittenOnDestruction()) { writeResults("output"); }
+	}
+
+	Observer::Summary Momentizer::getSummary() {
+		static const char* axes[MC_DIMS] = { "x", "y", "z" };
+		Summary summary;
+		if (samples.empty()) { return summary; }
+		const Sample& sample = samples.back();
+		const Moments& m = sample.moments;
+		summary["t"] = sample.t;
+		summary["pop"] = (double)sample.population;
+		summary["weight"] = m.weight;
+		for (int d = 0; d < MC_DIMS; ++d) {
+			double xx = m.getCovariance(d, d);
+			double vv = m.getCovariance(MC_DIMS + d, MC_DIMS + d);
+			double xv = m.getCovariance(d, MC_DIMS + d);
+			summary[std::string("mean_") + axes[d]] = m.mean[d];
+			summary[std::string("mean_v") + axes[d]] = m.mean[MC_DIMS + d];
+			summary[std::string("vvar_") + axes[d]] = vv;
+			if (m_speciesMass > 0.0) { summary[std::string("T_") + axes[d]] = m_speciesMass * vv / boltzmannConstant; }
+			summary[std::string("emittance_") + axes[d]] = std::sqrt(std::max(0.0, xx * vv - xv * xv));
+		}
+		summary["psd"] = getPeakDensity(m);
+		return summary;
+	}
+
+	void Momentizer::writeResults(const std::string& dir) {
+		MC_PROFILE_FUNCTION();
+		std::ofstream outputStream;
+		std::string filename = dir + "/moments";
+		if (m_instance > 0) { filename += std::to_string(m_instance); }
+		filename += ".json";
+		outputStream.open(filename);
+		if (!outputStream.is_open())
+		{
+			if (Log::getCoreLogger()) // Edge case: destructor might be before Log::init()
+			{
+				MC_CORE_ERROR("Momentizer could not open output file.");
+			}
+			exit(-1);
+		}
+		outputStream << std::scientific << std::setprecision(6);
+		outputStream << "{\"moments\":[";
+		for (size_t s = 0; s < samples.size(); ++s) {
+			const Sample& sample = samples.at(s);
+			const Moments& m = sample.moments;
+			if (s > 0) { outputStream << ","; }
+			outputStream << "{\"t\":" << sample.t << ",\"pop\":" << sample.population << ",\"weight\":" << m.weight;
+
+			// means and (upper triangle of) covariance matrix, ordered x, y, z, vx, vy, vz
+			outputStream << ",\"mean\":[";
+			for (int i = 0; i < nCoords; ++i) {
+				if (i > 0) { outputStream << ","; }
+				outputStream << m.mean[i];
+			}
+			outputStream << "],\"cov\":[";
+			for (int i = 0; i < nCoords; ++i) {
+				for (int j = i; j < nCoords; ++j) {
+					if (i + j > 0) { outputStream << ","; }
+					outputStream << m.getCovariance(i, j);
+				}
+			}
+
+			// velocity variances, kinetic temperatures (T = m <(v - <v>)^2> / kB) and rms emittances per dimension
+			outputStream << "],\"vvar\":[";
+			for (int d = 0; d < MC_DIMS; ++d) {
+				if (d > 0) { outputStream << ","; }
+				outputStream << m.getCovariance(MC_DIMS + d, MC_DIMS + d);
+			}
+			if (m_speciesMass > 0.0) {
+				outputStream << "],\"T\":[";
+				for (int d = 0; d < MC_DIMS; ++d) {
+					if (d > 0) { outputStream << ","; }
+					outputStream << m_speciesMass * m.getCovariance(MC_DIMS + d, MC_DIMS + d) / boltzmannConstant;
+				}
+			}
+			outputStream << "],\"emittance\":[";
+			for (int d = 0; d < MC_DIMS; ++d) {
+				if (d > 0) { outputStream << ","; }
+				double xx = m.getCovariance(d, d);
+				double vv = m.getCovariance(MC_DIMS + d, MC_DIMS + d);
+				double xv = m.getCovariance(d, MC_DIMS + d);
+				outputStream << std::sqrt(std::max(0.0, xx * vv - xv * xv));
+			}
+
+			outputStream << "],\"psd\":" << getPeakDensity(m) << "}";
+		}
+		outputStream << "]}";
+		outputStream.flush();
+		outputStream.close();
+	}
+}
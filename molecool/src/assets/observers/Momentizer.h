@@ -0,0 +1,77 @@
+#pragma once
+
+#include "core/Watcher.h"
+
+namespace molecool {
+
+    // records per-sample-time phase-space moments of the ensemble (means, covariances) along with
+    // derived quantities (velocity variances, rms emittances, peak phase-space density, and kinetic temperatures if the
+    // species mass is given, the ensemble masses are in engine units)
+    // the moments are accumulated in a single parallel pass over the ensemble using numerically stable
+    // streaming (Welford-style) updates, per-thread partial results are merged pairwise (Chan et al.)
+    // memory use is fixed per sample time, independent of the ensemble size
+    class Momentizer : public Observer
+    {
+	public:
+
+		static constexpr int nCoords = 2 * MC_DIMS;		// phase-space coordinates x, y, z, vx, vy, vz
+
+		// optional per-particle statistical weight, particles are equally weighted by default
+		using WeightFunction = std::function< double(const ParticleProxy& /*particle*/) >;
+
+		// streaming accumulator of weighted phase-space moments
+		struct Moments {
+			double weight = 0.0;									// sum of weights (the particle count if unweighted)
+			double massWeight = 0.0;								// sum of weight * mass
+			std::array<double, nCoords> mean{};						// weighted means
+			std::array<double, nCoords * nCoords> comoment{};		// weighted sums of products of deviations from the mean
+
+			void add(const double* q, double w, double m);
+			void merge(const Moments& other);
+			inline double getCovariance(int i, int j) const { return weight > 0.0 ? comoment[std::min(i, j) * nCoords + std::max(i, j)] / weight : 0.0; }
+			inline double getMeanMass() const { return weight > 0.0 ? massWeight / weight : 0.0; }
+		};
+
+		struct Sample {
+			double t;
+			long long population;
+			Moments moments;
+		};
+
+		// speciesMass in kg, for the kinetic temperatures
+		Momentizer(WeightFunction wf = WeightFunction(), double speciesMass = 0.0);
+		~Momentizer();
+		void operator()(const Ensemble& ens, double t) override;
+		void saveState(BinaryWriter& out) const override;
+		void loadState(BinaryReader& in) override;
+		void writeResults(const std::string& dir) override;
+		void reset() override;
+		void beginBatch(long long batch, long long firstParticle) override;
+		Summary getSummary() override;		// the last sample: t, pop, weight, mean_x..., vvar_x..., T_x..., emittance_x..., psd
+
+		static ObserverPtr make() {
+			return std::make_shared<Momentizer>();
+		}
+		static ObserverPtr makeWithMass(double speciesMass) {
+			return std::make_shared<Momentizer>(WeightFunction(), speciesMass);
+		}
+
+	private:
+		WeightFunction m_weight;
+		double m_speciesMass = 0.0;			// kg, no temperatures are written if <= 0
+		std::vector<Sample> samples;
+		size_t m_sample = 0;				// index of the next sample, batches are merged into the samples of the same times
+		std::vector<Moments> m_partials;	// per-thread partial results, reused between samples
+		int m_instance = 0;
+		static int s_instance;
+
+		// determinant of a (small) dense symmetric matrix, used for the phase-space volume
+		static double determinant(std::array<double, nCoords * nCoords> a);
+
+		// peak phase-space density of the equivalent (6D) gaussian distribution
+		static double getPeakDensity(const Moments& m);
+
+    };
+}
+
+
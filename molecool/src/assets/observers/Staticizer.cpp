@@ -10,14 +10,51 @@ namespace molecool {
 
 	void Staticizer::operator()(const Ensemble& ens, double t) {
 		MC_PROFILE_FUNCTION();
-		lifetime.push_back(std::make_pair(t, ens.getPopulation()));
+		// batches are merged by sample time, as in Momentizer
+		double tolerance = 1e-9 * std::max(1.0, std::abs(t));
+		while (m_sample < lifetime.size() && lifetime[m_sample].first < t - tolerance) { m_sample++; }
+		if (m_sample < lifetime.size() && std::abs(lifetime[m_sample].first - t) <= tolerance) { lifetime[m_sample].second += ens.getPopulation(); }
+		else { lifetime.insert(lifetime.begin() + m_sample, std::make_pair(t, (long long)ens.getPopulation())); }
+		m_sample++;
+	}
+
+	void Staticizer::reset() {
+		lifetime.clear();
+		m_sample = 0;
+	}
+
+	void Staticizer::beginBatch(long long batch, long long firstParticle) {
+		m_sample = 0;
+	}
+
+	void Staticizer::saveState(BinaryWriter& out) const {
+		out.write(lifetime);
+	}
+
+	void Staticizer::loadState(BinaryReader& in) {
+		in.read(lifetime);
+		m_sample = lifetime.size();
 	}
 
 	Staticizer::~Staticizer() {
 		MC_PROFILE_FUNCTION();
 		MC_CORE_TRACE("Destroying staticizer");
+		if (isWrittenOnDestruction()) { writeResults("output"); }
+	}
+
+	Observer::Summary Staticizer::getSummary() {
+		Summary summary;
+		if (!lifetime.empty()) {
+			summary["t"] = lifetime.back().first;
+			summary["pop"] = (double)lifetime.back().second;
+		}
+		return summary;
+	}
+
+	void Staticizer::writeResults(const std::string& dir) {
+		MC_PROFILE_FUNCTION();
 		std::ofstream outputStream;
-		outputStream.open("output/statistics.json");
+		outputStream.open(dir + "/statistics.json");
 		if (!outputStream.is_open())
 		{
 			if (Log::getCoreLogger()) // Edge case: destructor might be before Log::init()
@@ -8,12 +8,18 @@ namespace molecool {
     {
 	public:
 
-		using LifetimePoint = std::pair<double, int>;
+		using LifetimePoint = std::pair<double, long long>;
 		using Lifetime = std::vector<LifetimePoint>;
 
 		Staticizer();
 		~Staticizer();
 		void operator()(const Ensemble& ens, double t) override;
+		void saveState(BinaryWriter& out) const override;
+		void loadState(BinaryReader& in) override;
+		void writeResults(const std::string& dir) override;
+		void reset() override;
+		void beginBatch(long long batch, long long firstParticle) override;
+		Summary getSummary() override;		// t and pop of the last sample
 
 		static ObserverPtr make() {
 			return std::make_shared<Staticizer>();
@@ -21,6 +27,7 @@ namespace molecool {
 
 	private:
 		Lifetime lifetime;
+		size_t m_sample = 0;		// index of the next sample, batches add their populations to the samples of the same times
 
     };
 }
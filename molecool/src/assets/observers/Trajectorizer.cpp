@@ -5,28 +5,124 @@ namespace molecool {
 
 	int Trajectorizer::s_instance = 0;
 
-	Trajectorizer::Trajectorizer(int nParticles)
-		: m_nParticles(nParticles), m_instance(s_instance)
+	Trajectorizer::Trajectorizer(int nParticles, double tolerance)
+		: m_nParticles(nParticles), m_tolerance(tolerance), m_instance(s_instance)
 	{
 		MC_CORE_TRACE("Creating trajectorizer, tracking first {0} trajectories", m_nParticles);
-		trajectories.resize(m_nParticles);
+		if (m_tolerance > 0.0) {
+			MC_CORE_TRACE("Compressing trajectories with tolerance {0}", m_tolerance);
+		}
+		reset();
 		s_instance++;
 	}
 
 	void Trajectorizer::operator()(const Ensemble& ens, double t) {
 		MC_PROFILE_FUNCTION();
-		for (int i = 0; i < m_nParticles; ++i) {
+		// only the first m_nParticles particles (of the whole ensemble, in an out-of-core run) are tracked
+		if (m_firstParticle >= m_nParticles) { return; }
+		int offset = (int)m_firstParticle;
+		int n = std::min(m_nParticles - offset, (int)ens.pos.size() / MC_DIMS);
+		startTrajectories(ens, offset, n);
+		#pragma omp parallel for schedule(static) if(n > 64)
+		for (int i = 0; i < n; ++i) {
 			if (ens.isParticleActive(i)) {
-				trajectories.at(i).push_back(std::make_pair(t, ens.getParticlePos(i)));
+				int k = m_current[offset + i];
+				if (m_tolerance > 0.0) {
+					addCompressed(k, std::make_pair(t, ens.getParticlePos(i)));
+				}
+				else {
+					trajectories.at(k).push_back(std::make_pair(t, ens.getParticlePos(i)));
+				}
+			}
+		}
+	}
+
+	// serial, the trajectories may be reallocated
+	void Trajectorizer::startTrajectories(const Ensemble& ens, int offset, int n) {
+		for (int i = 0; i < n; ++i) {
+			if (!ens.isParticleActive(i)) { continue; }
+			uint32_t generation = ens.getSlotGeneration(i) + 1;
+			uint32_t& seen = m_seen[offset + i];
+			if (seen != 0 && seen != generation) {
+				finish(m_current[offset + i]);
+				m_current[offset + i] = (int)trajectories.size();
+				trajectories.emplace_back();
+				if (m_tolerance > 0.0) { m_pending.emplace_back(); }
 			}
+			seen = generation;
+		}
+	}
+
+	void Trajectorizer::finish(int i) {
+		if (m_tolerance > 0.0 && !m_pending[i].empty()) {
+			trajectories[i].push_back(m_pending[i].back());
+			m_pending[i].clear();
+		}
+	}
+
+	// the segment from the last retained point to the new point is accepted if it passes within tolerance of
+	// all pending points, otherwise the most recent pending point (whose own segment was accepted) is retained
+	void Trajectorizer::addCompressed(int i, const TrajectoryPoint& p) {
+		Trajectory& kept = trajectories[i];
+		Trajectory& pending = m_pending[i];
+		if (kept.empty()) {
+			kept.push_back(p);
+			return;
+		}
+		const TrajectoryPoint& a = kept.back();
+		bool accept = pending.size() < s_maxPending;
+		double span = p.first - a.first;
+		for (size_t k = 0; accept && k < pending.size(); ++k) {
+			const TrajectoryPoint& q = pending[k];
+			double f = span > 0.0 ? (q.first - a.first) / span : 0.0;
+			Position d = q.second - (a.second + f * (p.second - a.second));
+			accept = (d.x * d.x + d.y * d.y + d.z * d.z) <= m_tolerance * m_tolerance;
 		}
+		if (!accept) {
+			kept.push_back(pending.back());
+			pending.clear();
+		}
+		pending.push_back(p);
+	}
+
+	void Trajectorizer::reset() {
+		trajectories.assign(m_nParticles, Trajectory());
+		m_pending.assign(m_tolerance > 0.0 ? m_nParticles : 0, Trajectory());
+		m_current.resize(m_nParticles);
+		for (int i = 0; i < m_nParticles; ++i) { m_current[i] = i; }
+		m_seen.assign(m_nParticles, 0);
+	}
+
+	void Trajectorizer::beginBatch(long long batch, long long firstParticle) {
+		m_firstParticle = firstParticle;
+	}
+
+	void Trajectorizer::saveState(BinaryWriter& out) const {
+		out.write(trajectories);
+		out.write(m_pending);
+		out.write(m_current);
+		out.write(m_seen);
+	}
+
+	void Trajectorizer::loadState(BinaryReader& in) {
+		in.read(trajectories);
+		in.read(m_pending);
+		in.read(m_current);
+		in.read(m_seen);
 	}
 
 	Trajectorizer::~Trajectorizer() {
 		MC_PROFILE_FUNCTION();
 		MC_CORE_TRACE("Destroying trajectorizer");
+		if (isWrittenOnDestruction()) { writeResults("output"); }
+	}
+
+	void Trajectorizer::writeResults(const std::string& dir) {
+		MC_PROFILE_FUNCTION();
+		// the final point of a compressed trajectory is always retained
+		for (size_t i = 0; i < m_pending.size(); ++i) { finish((int)i); }
 		std::ofstream outputStream;
-		std::string filename = "output/trajectories";
+		std::string filename = dir + "/trajectories";
 		if (m_instance > 0) { filename += std::to_string(m_instance); }
 		filename += ".json";
 		outputStream.open(filename);
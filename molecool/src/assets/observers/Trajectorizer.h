@@ -12,21 +12,49 @@ namespace molecool {
 		using TrajectoryPoint = std::pair<double, Position>;
 		using Trajectory = std::vector<TrajectoryPoint>;
 
-		Trajectorizer(int nParticles);
+		// with a (positive) tolerance, trajectories are compressed on the fly: a point is only retained when
+		// linear interpolation between the retained points would deviate from the skipped points by more
+		// than the tolerance (a streaming, error-bounded Douglas-Peucker variant)
+		Trajectorizer(int nParticles, double tolerance = 0.0);
 		~Trajectorizer();
 		void operator()(const Ensemble& ens, double t) override;
+		void saveState(BinaryWriter& out) const override;
+		void loadState(BinaryReader& in) override;
+		void writeResults(const std::string& dir) override;
+		void reset() override;
+		void beginBatch(long long batch, long long firstParticle) override;
 
 		// a factory-like function that knows how to create this object (on the heap)
 		static ObserverPtr make(int n) {
 			return std::make_shared<Trajectorizer>(n);
 		}
 
+		static ObserverPtr makeCompressed(int n, double tolerance) {
+			return std::make_shared<Trajectorizer>(n, tolerance);
+		}
+
 	private:
 		int m_nParticles;
-		std::vector<Trajectory> trajectories;
+		double m_tolerance;
+		std::vector<Trajectory> trajectories;	// the first m_nParticles are those of the tracked slots' first particles
+		std::vector<Trajectory> m_pending;		// (compression only) points since the last retained point, not yet decided
+		std::vector<int> m_current;				// the trajectory of each tracked slot's current particle
+		std::vector<uint32_t> m_seen;			// slot generation + 1 of each tracked slot's current particle, 0 if none yet
+		long long m_firstParticle = 0;			// index of the ensemble's first particle in an out-of-core run
 		int m_instance = 0;
 		static int s_instance;
 
+		// maximum number of undecided points per trajectory, bounds the per-step cost of the tolerance test
+		static constexpr size_t s_maxPending = 256;
+
+		void addCompressed(int i, const TrajectoryPoint& p);
+
+		// retain the final point of a compressed trajectory
+		void finish(int i);
+
+		// a refilled slot (see Ensemble::getSlotGeneration) holds a new particle, which gets a new trajectory
+		void startTrajectories(const Ensemble& ens, int offset, int n);
+
     };
 }
 
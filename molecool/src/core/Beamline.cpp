@@ -0,0 +1,120 @@
+#include "mcpch.h"
+#include "Beamline.h"
+
+namespace molecool {
+
+    void Beamline::configure(int axis, double cellSize) {
+        m_axis = axis;
+        m_cellSize = cellSize;
+    }
+
+    void Beamline::addElement(const Element& element) {
+        MC_CORE_TRACE("Adding beamline element '{0}' [{1}, {2}]", element.name, element.from, element.to);
+        m_elements.push_back(element);
+        if (m_elements.back().to < m_elements.back().from) { std::swap(m_elements.back().from, m_elements.back().to); }
+    }
+
+    void Beamline::build() {
+        m_cells.clear();
+        if (m_elements.empty()) { return; }
+        double lo = std::numeric_limits<double>::infinity();
+        double hi = -std::numeric_limits<double>::infinity();
+        double totalLength = 0.0;
+        for (const auto& e : m_elements) {
+            lo = std::min(lo, e.from);
+            hi = std::max(hi, e.to);
+            totalLength += e.to - e.from;
+        }
+
+        // by default about one cell per element length, so a cell lists few elements
+        m_cell = m_cellSize > 0.0 ? m_cellSize : totalLength / m_elements.size();
+        if (!(m_cell > 0.0)) { m_cell = std::max(hi - lo, 1.0); }
+        m_cell = std::max(m_cell, (hi - lo) / s_maxCells);
+        m_origin = lo;
+        m_end = hi;
+        int nCells = std::max(1, (int)std::ceil((hi - lo) / m_cell));
+        m_cells.resize(nCells);
+        for (int id = 0; id < (int)m_elements.size(); ++id) {
+            int c0 = std::min(nCells - 1, (int)((m_elements[id].from - m_origin) / m_cell));
+            int c1 = std::min(nCells - 1, (int)((m_elements[id].to - m_origin) / m_cell));
+            for (int c = c0; c <= c1; ++c) { m_cells[c].push_back(id); }
+        }
+        MC_CORE_INFO("Beamline of {0} elements over [{1}, {2}], {3} cells", m_elements.size(), lo, hi, nCells);
+    }
+
+    Beamline::Bins& Beamline::getBins() {
+        thread_local Bins bins;
+        return bins;
+    }
+
+    void Beamline::bin(const Ensemble& ens, const int* particles, int n, bool forces, Bins& bins) const {
+        if (bins.members.size() < m_elements.size()) { bins.members.resize(m_elements.size()); }
+        bins.touched.clear();
+        int nCells = (int)m_cells.size();
+        for (int j = 0; j < n; ++j) {
+            double s = ens.pos[(size_t)particles[j] * MC_DIMS + m_axis];
+            if (!(s >= m_origin && s <= m_end)) { continue; }
+            int c = std::min(nCells - 1, (int)((s - m_origin) / m_cell));
+            for (int id : m_cells[c]) {
+                const Element& e = m_elements[id];
+                if (s < e.from || s > e.to || (forces ? e.forces.empty() : e.filters.empty())) { continue; }
+                if (bins.members[id].empty()) { bins.touched.push_back(id); }
+                bins.members[id].push_back(j);
+            }
+        }
+        std::sort(bins.touched.begin(), bins.touched.end());
+    }
+
+    void Beamline::evaluateForces(const Ensemble& ens, const int* particles, int n, double t, double* fx, double* fy, double* fz) const {
+        std::fill(fx, fx + n, 0.0);
+        std::fill(fy, fy + n, 0.0);
+        std::fill(fz, fz + n, 0.0);
+        Bins& bins = getBins();
+        bin(ens, particles, n, true, bins);
+        for (int id : bins.touched) {
+            std::vector<int>& members = bins.members[id];
+            int m = (int)members.size();
+            bins.particles.resize(m);
+            for (int i = 0; i < m; ++i) { bins.particles[i] = particles[members[i]]; }
+            for (auto& r : bins.results) { r.resize(m); }
+            for (const auto& f : m_elements[id].forces) {
+                f(ens, bins.particles.data(), m, t, bins.results[0].data(), bins.results[1].data(), bins.results[2].data());
+                for (int i = 0; i < m; ++i) {
+                    fx[members[i]] += bins.results[0][i];
+                    fy[members[i]] += bins.results[1][i];
+                    fz[members[i]] += bins.results[2][i];
+                }
+            }
+            members.clear();
+        }
+    }
+
+    void Beamline::evaluateFilters(const Ensemble& ens, const int* particles, int n, double t, double* stop) const {
+        std::fill(stop, stop + n, 0.0);
+        Bins& bins = getBins();
+        bin(ens, particles, n, false, bins);
+        for (int id : bins.touched) {
+            std::vector<int>& members = bins.members[id];
+            int m = (int)members.size();
+            bins.particles.resize(m);
+            for (int i = 0; i < m; ++i) { bins.particles[i] = particles[members[i]]; }
+            bins.results[0].resize(m);
+            for (const auto& f : m_elements[id].filters) {
+                f(ens, bins.particles.data(), m, t, bins.results[0].data());
+                for (int i = 0; i < m; ++i) {
+                    if (bins.results[0][i] != 0.0) { stop[members[i]] = 1.0; }
+                }
+            }
+            members.clear();
+        }
+    }
+
+    int Beamline::nameToAxis(const std::string& name) {
+        if (name == "x") { return 0; }
+        if (name == "y") { return 1; }
+        if (name == "z") { return 2; }
+        MC_CORE_WARN("unknown beam axis '{0}', using z", name);
+        return 2;
+    }
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Ensemble.h"
+#include "Thruster.h"
+
+namespace molecool {
+
+    // a beamline: a sequence of elements localized along the beam axis (skimmers, hexapoles, decelerator stages, coils),
+    // each with forces and aperture filters that act only on particles within its interval [from, to] on the axis
+    // a uniform grid of cells along the axis lists the elements overlapping each cell, the particles of a chunk are
+    // binned by element (a cell lookup each), and every element's functions are called for its own particles only, so
+    // the cost per particle and step follows the local element count rather than the length of the beamline
+    class Beamline
+    {
+    public:
+        struct Element {
+            std::string name;
+            double from = 0.0;
+            double to = 0.0;
+            std::vector<ChunkForceFunction> forces;
+            std::vector<ChunkFilterFunction> filters;
+        };
+
+        // axis 0, 1, 2 is x, y, z, a cell size <= 0 is chosen from the element lengths
+        void configure(int axis, double cellSize = 0.0);
+        void addElement(const Element& element);
+
+        // (re)build the index, after the last element was added
+        void build();
+
+        // chunk functions (see Thruster), the sums over the elements containing each particle
+        void evaluateForces(const Ensemble& ens, const int* particles, int n, double t, double* fx, double* fy, double* fz) const;
+        void evaluateFilters(const Ensemble& ens, const int* particles, int n, double t, double* stop) const;
+
+        inline bool isEmpty() const { return m_elements.empty(); }
+        inline int getAxis() const { return m_axis; }
+        inline const std::vector<Element>& getElements() const { return m_elements; }
+
+        static int nameToAxis(const std::string& name);
+
+        static constexpr int s_maxCells = 1 << 20;
+
+    private:
+        int m_axis = 2;
+        double m_cellSize = 0.0;                    // as configured
+        double m_origin = 0.0;                      // start of the first cell
+        double m_end = 0.0;                         // end of the last element
+        double m_cell = 1.0;                        // cell size used
+        std::vector<Element> m_elements;
+        std::vector<std::vector<int>> m_cells;      // the elements overlapping each cell
+
+        // the particles of a call binned by element, per thread
+        struct Bins {
+            std::vector<std::vector<int>> members;  // by element, positions in the particle list
+            std::vector<int> touched;               // elements with members, sorted
+            std::vector<int> particles;             // the particles of one element
+            std::vector<double> results[MC_DIMS];
+        };
+
+        // bin the particles into the elements containing them (with forces, or with filters)
+        void bin(const Ensemble& ens, const int* particles, int n, bool forces, Bins& bins) const;
+        static Bins& getBins();
+    };
+
+}
@@ -0,0 +1,129 @@
+#include "mcpch.h"
+#include "Checkpointer.h"
+
+#include <csignal>
+#include <filesystem>
+
+namespace molecool {
+
+    // file layout: magic (8 bytes), payload size (8 bytes), payload
+    static const char checkpointMagic[8] = { 'M', 'C', 'C', 'K', 'P', 'T', '0', '1' };
+
+    std::atomic<int> Checkpointer::s_signal(0);
+
+    Checkpointer::Checkpointer()
+    {}
+
+    Checkpointer::~Checkpointer() {
+        wait();
+    }
+
+    void Checkpointer::configure(const std::string& filename, double interval, bool resume) {
+        m_filename = filename;
+        m_interval = interval;
+        m_resume = resume;
+        m_enabled = true;
+        m_primed = false;
+        MC_CORE_TRACE("Checkpointing to {0} every {1} (resume: {2})", m_filename, m_interval, m_resume);
+        std::signal(SIGTERM, signalHandler);
+#ifdef SIGUSR1
+        std::signal(SIGUSR1, signalHandler);
+#endif
+    }
+
+    void Checkpointer::signalHandler(int signal) {
+        // only async-signal-safe work here, the simulation loop polls the flag
+        // a pending SIGTERM must not be downgraded by a later SIGUSR1
+        if (s_signal.load() != SIGTERM) { s_signal.store(signal); }
+    }
+
+    bool Checkpointer::isDue(double t) {
+        if (!m_enabled) { return false; }
+        int signal = s_signal.load();
+        if (signal != 0) {
+            if (signal != SIGTERM) { s_signal.store(0); }     // one checkpoint per SIGUSR1
+            MC_CORE_INFO("Checkpoint requested by signal {0}", signal);
+            return true;
+        }
+        if (m_interval <= 0.0) { return false; }
+        if (!m_primed) {
+            m_nextTime = t + m_interval;
+            m_primed = true;
+            return false;
+        }
+        if (t < m_nextTime - 1e-9 * m_interval) { return false; }
+        while (m_nextTime <= t + 1e-9 * m_interval) { m_nextTime += m_interval; }
+        return true;
+    }
+
+    bool Checkpointer::isStopRequested() const {
+        return s_signal.load() == SIGTERM;
+    }
+
+    void Checkpointer::write(std::vector<char>&& buffer) {
+        wait();
+        std::string filename = m_filename;
+        m_pending = std::async(std::launch::async, [filename, buffer = std::move(buffer)]() -> bool {
+            // write to a temporary file and swap it in, so an interrupted write never destroys the previous checkpoint
+            std::string tempname = filename + ".tmp";
+            std::ofstream outputStream(tempname, std::ios::binary);
+            if (!outputStream.is_open()) {
+                MC_CORE_ERROR("Checkpointer could not open {0}", tempname);
+                return false;
+            }
+            uint64_t size = buffer.size();
+            outputStream.write(checkpointMagic, sizeof(checkpointMagic));
+            outputStream.write((const char*)&size, sizeof(size));
+            outputStream.write(buffer.data(), buffer.size());
+            outputStream.close();
+            if (!outputStream) {
+                MC_CORE_ERROR("Checkpointer failed writing {0}", tempname);
+                return false;
+            }
+            std::error_code ec;
+            std::filesystem::rename(tempname, filename, ec);
+            if (ec) {
+                MC_CORE_ERROR("Checkpointer could not replace {0}: {1}", filename, ec.message());
+                return false;
+            }
+            return true;
+        });
+    }
+
+    void Checkpointer::wait() {
+        if (m_pending.valid()) {
+            MC_PROFILE_SCOPE("checkpoint wait");
+            m_pending.get();
+        }
+    }
+
+    bool Checkpointer::exists() const {
+        return std::filesystem::exists(m_filename);
+    }
+
+    bool Checkpointer::read(std::vector<char>& buffer) {
+        MC_PROFILE_FUNCTION();
+        wait();
+        std::ifstream inputStream(m_filename, std::ios::binary);
+        if (!inputStream.is_open()) {
+            MC_CORE_WARN("No checkpoint {0} to resume from", m_filename);
+            return false;
+        }
+        char magic[sizeof(checkpointMagic)];
+        uint64_t size = 0;
+        inputStream.read(magic, sizeof(magic));
+        inputStream.read((char*)&size, sizeof(size));
+        if (!inputStream || std::memcmp(magic, checkpointMagic, sizeof(magic)) != 0) {
+            MC_CORE_ERROR("{0} is not a molecool checkpoint", m_filename);
+            return false;
+        }
+        buffer.resize(size);
+        inputStream.read(buffer.data(), size);
+        if (!inputStream) {
+            MC_CORE_ERROR("Checkpoint {0} is truncated", m_filename);
+            return false;
+        }
+        return true;
+    }
+
+}
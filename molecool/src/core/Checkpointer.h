@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <future>
+#include "Serialization.h"
+
+namespace molecool {
+
+    // decides when the simulation state should be checkpointed, and writes/reads checkpoint files
+    // checkpoints are due at a fixed interval of simulation time, and additionally on request from outside:
+    // SIGUSR1 asks for a checkpoint, SIGTERM for a checkpoint followed by a clean stop (POSIX only)
+    // the simulation serializes its state into a buffer (a fast in-memory copy), and the buffer is written
+    // to disk by a background task, so propagation continues while the file is written
+    class Checkpointer
+    {
+    public:
+        Checkpointer();
+        ~Checkpointer();
+
+        // enable checkpointing, an interval <= 0 disables periodic checkpoints (signals still trigger them)
+        void configure(const std::string& filename, double interval, bool resume);
+        inline bool isEnabled() const { return m_enabled; }
+        inline bool isResumeRequested() const { return m_enabled && m_resume; }
+
+        // true if a checkpoint should be taken after the step that ended at simulation time t
+        bool isDue(double t);
+
+        // true once SIGTERM has been received, the simulation should checkpoint and stop
+        bool isStopRequested() const;
+
+        // write the buffer to the checkpoint file in the background, waiting for a previous write if needed
+        void write(std::vector<char>&& buffer);
+
+        // block until any background write has finished
+        void wait();
+
+        // true if the checkpoint file exists (it may still be invalid)
+        bool exists() const;
+
+        // read the checkpoint file into buffer, returns false if there is no (valid) checkpoint
+        bool read(std::vector<char>& buffer);
+
+    private:
+        std::string m_filename = "output/checkpoint.bin";
+        double m_interval = 0.0;
+        double m_nextTime = 0.0;
+        bool m_enabled = false;
+        bool m_resume = false;
+        bool m_primed = false;
+        std::future<bool> m_pending;
+
+        static std::atomic<int> s_signal;
+        static void signalHandler(int signal);
+    };
+
+}
@@ -0,0 +1,132 @@
+#include "mcpch.h"
+#include "Convergence.h"
+
+#include <boost/math/distributions/students_t.hpp>
+
+namespace molecool {
+
+    static constexpr double boltzmannConstant = 1.380649e-23;	// J/K
+
+    void Convergence::addObservable(const std::string& name, ObservableFunction fn) {
+        MC_CORE_TRACE("Adding convergence observable {0}", name);
+        if (!fn) { return; }
+        m_observables.push_back({ name, fn });
+    }
+
+    void Convergence::configure(double relativeError, double confidence, int minBatches, double maxSeconds) {
+        m_relativeError = relativeError;
+        m_confidence = std::clamp(confidence, 0.5, 0.9999);
+        m_minBatches = std::max(2, minBatches);
+        m_maxSeconds = maxSeconds;
+    }
+
+    void Convergence::start() {
+        m_start = std::chrono::steady_clock::now();
+        m_batchParticles = 0;
+    }
+
+    // the batch means are equally weighted, so a batch with fewer particles than the others (the short last batch) is
+    // not used, its estimates have a different variance
+    void Convergence::addBatch(const Ensemble& ens, int nParticles) {
+        MC_PROFILE_FUNCTION();
+        if (m_batchParticles == 0) { m_batchParticles = nParticles; }
+        if (nParticles < m_batchParticles) {
+            MC_CORE_TRACE("batch of {0} particles (instead of {1}) not used for the convergence estimates", nParticles, m_batchParticles);
+            return;
+        }
+        for (auto& o : m_observables) {
+            double value = o.fn(ens, nParticles);
+            o.values.push_back(value);
+            double delta = value - o.mean;
+            o.mean += delta / o.values.size();
+            o.m2 += delta * (value - o.mean);
+        }
+        for (const auto& o : m_observables) {
+            MC_CORE_TRACE("{0} = {1} +- {2} after {3} batches", o.name, o.mean, getHalfWidth(o), o.values.size());
+        }
+    }
+
+    bool Convergence::isConverged() const {
+        if (getBatches() < m_minBatches) { return false; }
+        for (const auto& o : m_observables) {
+            if (getHalfWidth(o) > m_relativeError * std::abs(o.mean)) { return false; }
+        }
+        return true;
+    }
+
+    bool Convergence::isOutOfTime() const {
+        if (m_maxSeconds <= 0.0) { return false; }
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count() >= m_maxSeconds;
+    }
+
+    int Convergence::getBatches() const {
+        return m_observables.empty() ? 0 : (int)m_observables.front().values.size();
+    }
+
+    // half-width of the confidence interval of the mean
+    double Convergence::getHalfWidth(const Observable& o) const {
+        int n = (int)o.values.size();
+        if (n < 2) { return std::numeric_limits<double>::infinity(); }
+        double standardError = std::sqrt(o.m2 / (n - 1) / n);
+        return studentQuantile(0.5 + 0.5 * m_confidence, n - 1) * standardError;
+    }
+
+    // quantile of Student's t distribution
+    double Convergence::studentQuantile(double p, int dof) {
+        return boost::math::quantile(boost::math::students_t((double)dof), p);
+    }
+
+    void Convergence::write(const std::string& filename) const {
+        std::ofstream outputStream(filename);
+        if (!outputStream.is_open()) {
+            MC_CORE_ERROR("Convergence could not open output file {0}", filename);
+            return;
+        }
+        outputStream << std::scientific << std::setprecision(9);
+        outputStream << "{\"convergence\":{\"batches\":" << getBatches() << ",\"confidence\":" << m_confidence;
+        outputStream << ",\"converged\":" << (isConverged() ? "true" : "false") << ",\"observables\":[";
+        for (size_t i = 0; i < m_observables.size(); ++i) {
+            const Observable& o = m_observables[i];
+            outputStream << (i > 0 ? "," : "") << "{\"name\":\"" << o.name << "\",\"mean\":" << o.mean << ",\"halfWidth\":" << getHalfWidth(o);
+            outputStream << ",\"values\":[";
+            for (size_t b = 0; b < o.values.size(); ++b) { outputStream << (b > 0 ? "," : "") << o.values[b]; }
+            outputStream << "]}";
+        }
+        outputStream << "]}}";
+    }
+
+    Convergence::ObservableFunction Convergence::nameToObservable(const std::string& name, double speciesMass) {
+        if (name == "survival") {
+            return [](const Ensemble& ens, int nParticles) { return nParticles > 0 ? (double)ens.getPopulation() / nParticles : 0.0; };
+        }
+        int d = name == "vvarx" || name == "Tx" ? 0 : name == "vvary" || name == "Ty" ? 1 : name == "vvarz" || name == "Tz" ? 2 : -1;
+        bool temperature = name[0] == 'T';
+        if (d >= 0 && temperature && !(speciesMass > 0.0)) {
+            // the ensemble masses are in engine units, a temperature needs the mass of the species
+            MC_CORE_WARN("convergence observable {0} needs the species mass (mass = ... in kg)", name);
+            return ObservableFunction();
+        }
+        if (d >= 0) {
+            // velocity variance along d, <(v - <v>)^2> over the active particles, or the kinetic temperature m <(v - <v>)^2> / kB
+            double scale = temperature ? speciesMass / boltzmannConstant : 1.0;
+            return [d, scale](const Ensemble& ens, int nParticles) {
+                int nSlots = (int)ens.vel.size() / MC_DIMS;
+                double n = 0.0, sum = 0.0, sumSq = 0.0;
+                #pragma omp parallel for reduction(+:n, sum, sumSq)
+                for (int i = 0; i < nSlots; ++i) {
+                    if (!ens.isParticleActive(i)) { continue; }
+                    double v = ens.vel[i * MC_DIMS + d];
+                    n += 1.0;
+                    sum += v;
+                    sumSq += v * v;
+                }
+                if (n < 2.0) { return 0.0; }
+                double mean = sum / n;
+                return scale * std::max(0.0, sumSq / n - mean * mean);
+            };
+        }
+        MC_CORE_WARN("convergence observable {0} not recognized", name);
+        return ObservableFunction();
+    }
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include "Ensemble.h"
+
+namespace molecool {
+
+    // convergence-driven (adaptive) particle counts: the simulation propagates independent batches of particles, and
+    // every batch gives one estimate of each observable, e.g. the fraction of particles that survive to the end
+    // the batch means of the estimates and their confidence intervals (Student t, the batch estimates are independent)
+    // are updated after every batch, and the run stops once every observable is known to the target relative error
+    class Convergence
+    {
+    public:
+        // the value of an observable for a propagated batch, nParticles is the number of particles the batch started with
+        using ObservableFunction = std::function< double(const Ensemble& /*ens*/, int /*nParticles*/) >;
+
+        void addObservable(const std::string& name, ObservableFunction fn);
+        void configure(double relativeError, double confidence, int minBatches, double maxSeconds);
+        inline bool isEnabled() const { return !m_observables.empty(); }
+
+        void start();
+        void addBatch(const Ensemble& ens, int nParticles);
+
+        // true once every observable's confidence interval half-width is within the relative error of its mean
+        bool isConverged() const;
+        // true once the wall-clock budget is used up
+        bool isOutOfTime() const;
+
+        // the estimates, their confidence intervals and the batch values as JSON
+        void write(const std::string& filename) const;
+
+        // built-in observables: "survival" (fraction of particles still active), "vvarx", "vvary", "vvarz" (velocity
+        // variances), "Tx", "Ty", "Tz" (kinetic temperatures, these need the species mass in kg)
+        static ObservableFunction nameToObservable(const std::string& name, double speciesMass = 0.0);
+
+    private:
+        struct Observable {
+            std::string name;
+            ObservableFunction fn;
+            std::vector<double> values;     // one per batch
+            double mean = 0.0;
+            double m2 = 0.0;                // sum of squared deviations from the mean (Welford)
+        };
+
+        std::vector<Observable> m_observables;
+        double m_relativeError = 0.01;
+        double m_confidence = 0.95;
+        int m_minBatches = 5;
+        double m_maxSeconds = 0.0;          // no time limit if <= 0
+        std::chrono::steady_clock::time_point m_start;
+        int m_batchParticles = 0;           // the particles per batch, set by the first batch
+
+        int getBatches() const;
+        double getHalfWidth(const Observable& o) const;
+        static double studentQuantile(double p, int dof);
+    };
+
+}
@@ -14,47 +14,25 @@ namespace molecool {
 	{
 		MC_PROFILE_FUNCTION();
 		MC_CORE_TRACE("Adding {0} particles of type {1}", nParticles, pId);
+		int first = (int)(pos.size() / MC_DIMS);		// slot of the first new particle (slots of lost particles are kept)
 		try {
-				size_t nDists = 2 * MC_DIMS;
 				size_t nRandoms = nParticles * MC_DIMS;	
 				std::vector<double> tempPos(nRandoms);
 				std::vector<double> tempVel(nRandoms);
 				
 				{
 					MC_PROFILE_SCOPE("ensemble memory allocation");
-					pos.resize(pos.size() + nRandoms);
-					vel.resize(pos.size());
+					// the new states are first touched in parallel, by the threads that will propagate them
+					Memory::resizeFirstTouch(pos, pos.size() + nRandoms, 0.0, MC_DIMS);
+					Memory::resizeFirstTouch(vel, pos.size(), 0.0, MC_DIMS);
 
 					particleIds.resize(particleIds.size() + nParticles);
 					actives.resize(actives.size() + nParticles);
+					generations.resize(actives.size());
+					freeSlots.resize(actives.size());
 				}
 				
-				{
-					MC_PROFILE_SCOPE("ensemble random number generation");
-					// For random number generation, make a thread for each phase-space coordinate for simplicity
-					// create independent random number streams for each thread before parallel section
-					int seed = (int)time(0);
-					std::vector<std::shared_ptr<RandomStream>> sps;
-					for (int i = 0; i < nDists; ++i) {
-						sps.push_back(std::make_shared<RandomStream>(seed));
-					}
-					#pragma omp parallel for
-					for (int i = 0; i < nDists; ++i) {
-						if (i < MC_DIMS) {
-							dists[i].first.sample(sps[i], nParticles, tempPos, i * nParticles);
-							// enforce first particle comes from distribution center(s):
-							double* posPtr = (double*)&tempPos[i * nParticles];
-							posPtr[0] = dists[i].first.getPeak();	 
-						}
-						else {
-							int in = i - MC_DIMS;
-							dists[in].second.sample(sps[i], nParticles, tempVel, in * nParticles);
-							// enforce first particle comes from distribution center(s):
-							double* velPtr = (double*)&tempVel[in * nParticles];
-							velPtr[0] = dists[in].second.getPeak();
-						}
-					}
-				}
+				sample(nParticles, dists, tempPos, tempVel);
 				// in memory, tempPositions now looks like [ ... xs  ... ys ... zs ... ]
 				// and, similarly, tempVelocities looks like [ ... vxs ... vys ... vzs ... ]
 				// i.e. both look like row-major matrices (with contiguous storage) with MC_DIMS rows and nParticles columns
@@ -62,8 +40,8 @@ namespace molecool {
 				// transpose the temporary target vectors into class member vectors
 				{
 					MC_PROFILE_SCOPE("ensemble states initialization"); 
-					double* posPtr = (double*)pos.data() + population * MC_DIMS;
-					double* velPtr = (double*)vel.data() + population * MC_DIMS;
+					double* posPtr = (double*)pos.data() + first * MC_DIMS;
+					double* velPtr = (double*)vel.data() + first * MC_DIMS;
 					mkl_domatcopy('R', 'T', MC_DIMS, nParticles, 1, tempPos.data(), nParticles, posPtr, MC_DIMS);
 					mkl_domatcopy('R', 'T', MC_DIMS, nParticles, 1, tempVel.data(), nParticles, velPtr, MC_DIMS);
 				}
@@ -74,23 +52,123 @@ namespace molecool {
 		}
 
 		// new particles have successfully been added to the ensemble, record their ids and make them active
-		for (int i = population; i < population + nParticles; ++i) {
+		for (int i = first; i < first + nParticles; ++i) {
 			particleIds[i] = pId;
 			actives[i] = true;
 		}
 		population += nParticles;
 	}
 
+	// draw nParticles phase-space points, tempPos/tempVel are filled as [ ... xs ... ys ... zs ... ] (see addParticles)
+	void Ensemble::sample(int nParticles, std::array< std::pair< PosDist, VelDist>, MC_DIMS >& dists, std::vector<double>& tempPos, std::vector<double>& tempVel)
+	{
+		MC_PROFILE_SCOPE("ensemble random number generation");
+		size_t nDists = 2 * MC_DIMS;
+		tempPos.resize(nParticles * MC_DIMS);
+		tempVel.resize(nParticles * MC_DIMS);
+		// For random number generation, make a thread for each phase-space coordinate for simplicity
+		// create independent random number streams for each thread before parallel section
+		// the streams are kept, so particles added later (e.g. batches, sources) are not a replay of the first ones
+		bool firstSample = streams.empty();
+		if (firstSample) {
+			int seed = m_seed >= 0 ? m_seed : (int)time(0);
+			for (int i = 0; i < nDists; ++i) {
+				streams.push_back(std::make_shared<RandomStream>(seed));
+			}
+		}
+		#pragma omp parallel for
+		for (int i = 0; i < nDists; ++i) {
+			if (i < MC_DIMS) {
+				dists[i].first.sample(streams[i], nParticles, tempPos, i * nParticles);
+				// enforce first particle comes from distribution center(s):
+				double* posPtr = (double*)&tempPos[i * nParticles];
+				if (firstSample) { posPtr[0] = dists[i].first.getPeak(); }
+			}
+			else {
+				int in = i - MC_DIMS;
+				dists[in].second.sample(streams[i], nParticles, tempVel, in * nParticles);
+				// enforce first particle comes from distribution center(s):
+				double* velPtr = (double*)&tempVel[in * nParticles];
+				if (firstSample) { velPtr[0] = dists[in].second.getPeak(); }
+			}
+		}
+	}
+
+	// append empty (inactive) slots, for particles injected during propagation, so the states never grow in the step loop
+	void Ensemble::reserveSlots(int nSlots)
+	{
+		MC_PROFILE_FUNCTION();
+		if (nSlots <= 0) { return; }
+		MC_CORE_TRACE("Reserving {0} particle slots", nSlots);
+		int first = (int)(pos.size() / MC_DIMS);
+		Memory::resizeFirstTouch(pos, pos.size() + (size_t)nSlots * MC_DIMS, 0.0, MC_DIMS);
+		Memory::resizeFirstTouch(vel, pos.size(), 0.0, MC_DIMS);
+		particleIds.resize(first + nSlots);
+		actives.resize(first + nSlots, false);
+		generations.resize(first + nSlots);
+		freeSlots.resize(first + nSlots);
+		for (int i = first + nSlots - 1; i >= first; --i) {
+			freeSlots[nFree++] = i;
+		}
+	}
+
+	// fill free slots with new particles (called between steps), the lowest free slots are filled first, so the
+	// slots used do not depend on the order in which the threads lost particles
+	int Ensemble::injectParticles(int nParticles, ParticleId pId, std::array< std::pair< PosDist, VelDist>, MC_DIMS >& dists, std::vector<int>& slots)
+	{
+		MC_PROFILE_FUNCTION();
+		int nFreeSlots = nFree.load(std::memory_order_relaxed);
+		int n = std::min(nParticles, nFreeSlots);
+		if (n <= 0) { return 0; }
+		// the cost is in the slots freed since the last injection and the slots filled, not in all free slots
+		for (; m_heapSize < nFreeSlots; ++m_heapSize) {
+			std::push_heap(freeSlots.begin(), freeSlots.begin() + m_heapSize + 1, std::greater<int>());
+		}
+		sample(n, dists, m_scratchPos, m_scratchVel);
+		for (int k = 0; k < n; ++k) {
+			std::pop_heap(freeSlots.begin(), freeSlots.begin() + m_heapSize, std::greater<int>());
+			m_heapSize--;
+			int i = freeSlots[--nFreeSlots];
+			for (int d = 0; d < MC_DIMS; ++d) {
+				pos[i * MC_DIMS + d] = m_scratchPos[d * n + k];
+				vel[i * MC_DIMS + d] = m_scratchVel[d * n + k];
+			}
+			particleIds[i] = pId;
+			actives[i] = true;
+			generations[i]++;
+			slots.push_back(i);
+		}
+		nFree.store(nFreeSlots, std::memory_order_relaxed);
+		population += n;
+		return n;
+	}
+
+	// called concurrently from the parallel force loop (for distinct particles), the flags are separate bytes
+	// and the population count is decremented atomically, the slot goes to the free list (sized to hold every slot)
 	void Ensemble::deactivateParticle(int i) {
 		actives.at(i) = false;
+		#pragma omp atomic
 		population--;
+		freeSlots[nFree.fetch_add(1, std::memory_order_relaxed)] = i;
+	}
+
+	void Ensemble::clear() {
+		pos.clear();
+		vel.clear();
+		particleIds.clear();
+		actives.clear();
+		generations.clear();
+		freeSlots.clear();
+		nFree = 0;
+		m_heapSize = 0;
+		population = 0;
 	}
 
-	void Ensemble::save(std::string filename) {
+	void Ensemble::save(std::string filename, std::string dir) {
 		MC_PROFILE_FUNCTION();
 		MC_CORE_TRACE("saving ensemble states");
 		std::ofstream outputStream;
-		outputStream.open("output/" + filename + ".json");
+		outputStream.open(dir + "/" + filename + ".json");
 		if (!outputStream.is_open())
 		{
 			MC_CORE_ERROR("ensemble could not open output file");
@@ -98,14 +176,63 @@ namespace molecool {
 		}
 		outputStream << std::fixed << std::setprecision(6);
 		outputStream << "{\"" + filename + "\":[";
-		for (int i = 0; i < population; ++i) {
-			if (i > 0) { outputStream << ","; }
-			outputStream << "{\"x\":[" << getParticlePos(i) << "],";
-			outputStream << "\"v\":[" << getParticleVel(i) << "]}";
-		}
+		bool empty = true;
+		writeStates(outputStream, empty);
 		outputStream << "]}";
 		outputStream.flush();
 		outputStream.close();
 	}
 
+	void Ensemble::writeStates(std::ostream& out, bool& empty) const {
+		// the active particles, which need not be the first population slots once particles were lost or injected
+		for (int i = 0; i < (int)actives.size(); ++i) {
+			if (!actives[i]) { continue; }
+			if (!empty) { out << ","; }
+			empty = false;
+			out << "{\"x\":[" << getParticlePos(i) << "],";
+			out << "\"v\":[" << getParticleVel(i) << "]}";
+		}
+	}
+
+	void Ensemble::saveState(BinaryWriter& out) const {
+		MC_PROFILE_FUNCTION();
+		out.write(population);
+		out.write(pos);
+		out.write(vel);
+		out.write(particleIds);
+		out.write(actives);
+		out.write(generations);
+		out.write(std::vector<int>(freeSlots.begin(), freeSlots.begin() + nFree.load()));
+		// the streams sample the particles injected later, a restored ensemble continues them exactly
+		out.write<uint64_t>(streams.size());
+		for (const auto& stream : streams) { stream->saveState(out); }
+	}
+
+	void Ensemble::loadState(BinaryReader& in) {
+		MC_PROFILE_FUNCTION();
+		in.read(population);
+		// the state vectors are sized with a parallel first touch, the reads then copy into pages already placed
+		Memory::resizeFirstTouch(pos, (size_t)in.peekCount<double>(), 0.0, MC_DIMS);
+		in.read(pos);
+		Memory::resizeFirstTouch(vel, (size_t)in.peekCount<double>(), 0.0, MC_DIMS);
+		in.read(vel);
+		in.read(particleIds);
+		in.read(actives);
+		in.read(generations);
+		std::vector<int> free;
+		in.read(free);
+		freeSlots = free;
+		freeSlots.resize(actives.size());
+		nFree = (int)free.size();
+		m_heapSize = 0;
+		uint64_t nStreams = 0;
+		in.read(nStreams);
+		if (streams.size() != nStreams) {
+			// e.g. a run resumed from a checkpoint, whose initial ensemble was not sampled
+			streams.clear();
+			for (uint64_t k = 0; k < nStreams; ++k) { streams.push_back(std::make_shared<RandomStream>()); }
+		}
+		for (auto& stream : streams) { stream->loadState(in); }
+	}
+
 }
@@ -2,14 +2,17 @@
 
 #include <vector>
 #include <string>
+#include <atomic>
 #include "Core.h"
 #include "Random.h"
 #include "Vector.h"
+#include "Serialization.h"
+#include "Memory.h"
 
 namespace molecool {
 
-	// state type for odeint propagation
-	using state_type = std::vector<double>;
+	// state type for odeint propagation, aligned and placed by first touch (see NumaAllocator)
+	using state_type = std::vector<double, NumaAllocator<double>>;
 
 	enum class ParticleId { Rb, CaF, YbF};
 
@@ -29,10 +32,31 @@ namespace molecool {
 		inline bool isParticleActive(int i) const { return actives.at(i); }
 		inline double getParticleMass(int i) const { return 1; }
 		void deactivateParticle(int i);
+
+		// continuous sources: empty slots are reserved up front, particles injected during propagation fill the slots of
+		// lost particles (a free list), so the state vectors are never reallocated in the step loop, the slots of the
+		// injected particles are appended to slots
+		void reserveSlots(int nSlots);
+		int injectParticles(int nParticles, ParticleId pId, std::array< std::pair< PosDist, VelDist>, MC_DIMS >& dists, std::vector<int>& slots);
+		inline int getFreeSlots() const { return nFree.load(std::memory_order_relaxed); }
+		inline uint32_t getSlotGeneration(int i) const { return generations[i]; }	// changes whenever a slot is refilled
+
+		// a fixed seed makes the sampled ensemble reproducible (by default the seed is taken from the clock), set before adding particles
+		inline void setSeed(int seed) { m_seed = seed; }
+
+		// remove all particles, the storage is kept (and stays placed) for the next particles, e.g. the next batch of an out-of-core run
+		void clear();
 		inline Position getParticlePos(int i) const { return Position( (double*)&pos[i * MC_DIMS] ); }
 		inline Velocity getParticleVel(int i) const { return Velocity( (double*)&vel[i * MC_DIMS] ); }
 
-		void save(std::string filename);
+		void save(std::string filename, std::string dir = "output");
+		// the entries of the active particles for save(), comma separated, empty is true while nothing has been written to out (e.g. by
+		// previous batches), it is cleared once an entry is written
+		void writeStates(std::ostream& out, bool& empty) const;
+
+		// checkpoint support
+		void saveState(BinaryWriter& out) const;
+		void loadState(BinaryReader& in);
 
 		// ensemble (classical) state vectors organized by particle as [ x0, y0, z0, x1, y1, z1, ... ] for particle N = 0, 1, ... 
 		state_type pos, vel;
@@ -41,7 +65,22 @@ namespace molecool {
 		int population = 0;					// number of active particles in the ensemble
 
 		std::vector<ParticleId> particleIds;	// list of particle ids
-		std::vector<bool> actives;				// vector of active flags for participating particles
+		std::vector<char> actives;				// vector of active flags for participating particles (not vector<bool>: flags are written concurrently)
+
+		// free list of the slots of lost particles, sized to hold every slot, the first nFree entries are free
+		// the first m_heapSize of them form a min-heap (the lowest slot is refilled first), slots freed since the last
+		// injection follow them and are pushed into the heap by the next injection
+		std::vector<int> freeSlots;
+		std::atomic<int> nFree{ 0 };
+		int m_heapSize = 0;
+		std::vector<uint32_t> generations;		// number of times each slot has been (re)filled
+
+		// one random stream per phase-space coordinate, created with the first particles, later particles continue the streams
+		std::vector<std::shared_ptr<RandomStream>> streams;
+		std::vector<double> m_scratchPos, m_scratchVel;	// samples of injected particles, reused
+		int m_seed = -1;
+
+		void sample(int nParticles, std::array< std::pair< PosDist, VelDist>, MC_DIMS >& dists, std::vector<double>& tempPos, std::vector<double>& tempVel);
 
 	};
 
@@ -40,5 +40,6 @@ int main(int argc, char** argv) {
 	MC_PROFILE_END_SESSION();
 	//-------------------------------------
 
+	Log::shutdown();
 	return 0;
 }
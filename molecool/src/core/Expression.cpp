@@ -0,0 +1,374 @@
+#include "mcpch.h"
+#include "Expression.h"
+
+namespace molecool {
+
+    static constexpr double pi = 3.14159265358979323846;
+
+    // syntax tree, only used during compilation, constant subtrees are folded while parsing
+    struct Expression::Node {
+        Op op;
+        double value = 0.0;                         // constant
+        const double* parameter = nullptr;          // parameter
+        const SwitchingSchedule* schedule = nullptr;    // schedule
+        int component = 0;                          // load: 0..2 position, 3..5 velocity
+        NodePtr a, b;
+    };
+
+    struct Expression::Parser {
+        const std::string& src;
+        const Resolver& resolve;
+        const ScheduleResolver& resolveSchedule;
+        size_t pos = 0;
+        std::string error;
+
+        Parser(const std::string& source, const Resolver& res, const ScheduleResolver& sched)
+            : src(source), resolve(res), resolveSchedule(sched) {}
+
+        void fail(const std::string& what) {
+            if (error.empty()) { error = what + " at position " + std::to_string(pos) + " of \"" + src + "\""; }
+        }
+
+        void skipSpace() {
+            while (pos < src.size() && std::isspace((unsigned char)src[pos])) { ++pos; }
+        }
+
+        bool accept(const char* token) {
+            skipSpace();
+            size_t len = std::strlen(token);
+            if (src.compare(pos, len, token) != 0) { return false; }
+            // do not split "<=" into "<" and "=", or "!=" into "!" and "="
+            if (len == 1 && pos + 1 < src.size() && src[pos + 1] == '=' && std::strchr("<>=!", token[0])) { return false; }
+            pos += len;
+            return true;
+        }
+
+        static NodePtr leaf(Op op) {
+            NodePtr n = std::make_unique<Node>();
+            n->op = op;
+            return n;
+        }
+
+        static NodePtr constant(double value) {
+            NodePtr n = leaf(Op::constant);
+            n->value = value;
+            return n;
+        }
+
+        // operations on constants are folded into a constant
+        static NodePtr make(Op op, NodePtr a, NodePtr b = nullptr) {
+            if (a->op == Op::constant && (!b || b->op == Op::constant)) {
+                double value = 0.0;
+                compute(op, 1, &value, &a->value, b ? &b->value : &a->value);
+                return constant(value);
+            }
+            NodePtr n = leaf(op);
+            n->a = std::move(a);
+            n->b = std::move(b);
+            return n;
+        }
+
+        NodePtr parse() {
+            NodePtr n = parseOr();
+            skipSpace();
+            if (pos < src.size()) { fail("unexpected '" + std::string(1, src[pos]) + "'"); }
+            return n;
+        }
+
+        NodePtr parseOr() {
+            NodePtr n = parseAnd();
+            while (accept("||")) { n = make(Op::logicalOr, std::move(n), parseAnd()); }
+            return n;
+        }
+
+        NodePtr parseAnd() {
+            NodePtr n = parseComparison();
+            while (accept("&&")) { n = make(Op::logicalAnd, std::move(n), parseComparison()); }
+            return n;
+        }
+
+        NodePtr parseComparison() {
+            static const std::pair<const char*, Op> comparisons[] = {
+                { "<=", Op::le }, { ">=", Op::ge }, { "==", Op::eq }, { "!=", Op::ne }, { "<", Op::lt }, { ">", Op::gt }
+            };
+            NodePtr n = parseSum();
+            for (const auto& c : comparisons) {
+                if (accept(c.first)) { return make(c.second, std::move(n), parseSum()); }
+            }
+            return n;
+        }
+
+        NodePtr parseSum() {
+            NodePtr n = parseProduct();
+            while (true) {
+                if (accept("+")) { n = make(Op::add, std::move(n), parseProduct()); }
+                else if (accept("-")) { n = make(Op::sub, std::move(n), parseProduct()); }
+                else { return n; }
+            }
+        }
+
+        NodePtr parseProduct() {
+            NodePtr n = parseUnary();
+            while (true) {
+                if (accept("*")) { n = make(Op::mul, std::move(n), parseUnary()); }
+                else if (accept("/")) { n = make(Op::div, std::move(n), parseUnary()); }
+                else { return n; }
+            }
+        }
+
+        NodePtr parseUnary() {
+            if (accept("-")) { return make(Op::neg, parseUnary()); }
+            if (accept("+")) { return parseUnary(); }
+            if (accept("!")) { return make(Op::logicalNot, parseUnary()); }
+            return parsePower();
+        }
+
+        // right associative and binding tighter than a unary minus on its left, -x^2 is -(x^2)
+        NodePtr parsePower() {
+            NodePtr n = parsePrimary();
+            if (accept("^")) { n = make(Op::pow, std::move(n), parseUnary()); }
+            return n;
+        }
+
+        NodePtr parsePrimary() {
+            skipSpace();
+            if (pos >= src.size()) { fail("unexpected end"); return constant(0.0); }
+            char c = src[pos];
+            if (std::isdigit((unsigned char)c) || c == '.') {
+                const char* begin = src.c_str() + pos;
+                char* end = nullptr;
+                double value = std::strtod(begin, &end);
+                if (end == begin) { fail("bad number"); return constant(0.0); }
+                pos += end - begin;
+                return constant(value);
+            }
+            if (std::isalpha((unsigned char)c) || c == '_') {
+                size_t start = pos;
+                while (pos < src.size() && (std::isalnum((unsigned char)src[pos]) || src[pos] == '_')) { ++pos; }
+                std::string name = src.substr(start, pos - start);
+                if (accept("(")) { return parseCall(name); }
+                return variable(name);
+            }
+            if (accept("(")) {
+                NodePtr n = parseOr();
+                if (!accept(")")) { fail("missing ')'"); }
+                return n;
+            }
+            fail("unexpected '" + std::string(1, c) + "'");
+            return constant(0.0);
+        }
+
+        NodePtr parseCall(const std::string& name) {
+            struct Function { const char* name; int nArgs; Op op; };
+            static const Function functions[] = {
+                { "sin", 1, Op::sin }, { "cos", 1, Op::cos }, { "tan", 1, Op::tan }, { "asin", 1, Op::asin },
+                { "acos", 1, Op::acos }, { "atan", 1, Op::atan }, { "atan2", 2, Op::atan2 }, { "sinh", 1, Op::sinh },
+                { "cosh", 1, Op::cosh }, { "tanh", 1, Op::tanh }, { "exp", 1, Op::exp }, { "log", 1, Op::log },
+                { "log10", 1, Op::log10 }, { "sqrt", 1, Op::sqrt }, { "abs", 1, Op::abs }, { "floor", 1, Op::floor },
+                { "ceil", 1, Op::ceil }, { "min", 2, Op::min }, { "max", 2, Op::max }, { "pow", 2, Op::pow },
+                { "step", 1, Op::step }
+            };
+            for (const auto& f : functions) {
+                if (name != f.name) { continue; }
+                NodePtr a = parseOr();
+                NodePtr b;
+                if (f.nArgs == 2) {
+                    if (!accept(",")) { fail(name + "() takes 2 arguments"); }
+                    b = parseOr();
+                }
+                if (!accept(")")) { fail("missing ')' after the arguments of " + name + "()"); }
+                return make(f.op, std::move(a), std::move(b));
+            }
+            fail("unknown function '" + name + "'");
+            return constant(0.0);
+        }
+
+        NodePtr variable(const std::string& name) {
+            static const char* components[] = { "x", "y", "z", "vx", "vy", "vz" };
+            for (int c = 0; c < 2 * MC_DIMS; ++c) {
+                if (name == components[c]) {
+                    NodePtr n = leaf(Op::load);
+                    n->component = c;
+                    return n;
+                }
+            }
+            if (name == "t") { return leaf(Op::time); }
+            if (name == "r") { return leaf(Op::radius); }
+            if (name == "speed") { return leaf(Op::speed); }
+            if (name == "pi") { return constant(pi); }
+            if (const SwitchingSchedule* s = resolveSchedule ? resolveSchedule(name) : nullptr) {
+                NodePtr n = leaf(Op::schedule);
+                n->schedule = s;
+                return n;
+            }
+            const double* p = resolve ? resolve(name) : nullptr;
+            if (!p) { fail("unknown variable '" + name + "'"); return constant(0.0); }
+            NodePtr n = leaf(Op::parameter);
+            n->parameter = p;
+            return n;
+        }
+    };
+
+    Expression::Expression(const std::string& source, const Resolver& resolve, const ScheduleResolver& resolveSchedule)
+        : m_source(source)
+    {
+        Parser parser(source, resolve, resolveSchedule);
+        NodePtr root = parser.parse();
+        m_error = parser.error;
+        if (!m_error.empty()) {
+            MC_CORE_ERROR("Expression: {0}", m_error);
+            return;
+        }
+        emit(*root, 0);
+        m_result = 0;
+        MC_CORE_TRACE("Compiled expression \"{0}\" into {1} instructions, {2} registers", source, m_code.size(), m_nRegisters);
+    }
+
+    // the value of a node goes to register reg, its operands to reg and reg + 1 (a stack of registers), so the
+    // register count is the depth of the tree and the registers of a chunk stay in L1
+    void Expression::emit(const Node& node, int reg) {
+        m_nRegisters = std::max(m_nRegisters, reg + 1);
+        Instruction ins{ node.op, reg, reg, reg };
+        switch (node.op) {
+        case Op::constant:
+            ins.a = (int)m_constants.size();
+            m_constants.push_back(node.value);
+            break;
+        case Op::parameter:
+            ins.a = (int)m_parameters.size();
+            m_parameters.push_back(node.parameter);
+            break;
+        case Op::schedule:
+            ins.a = (int)m_schedules.size();
+            m_schedules.push_back(node.schedule);
+            break;
+        case Op::load:
+            ins.a = node.component;
+            break;
+        case Op::time: case Op::radius: case Op::speed:
+            break;
+        default:
+            emit(*node.a, reg);
+            if (node.b) {
+                emit(*node.b, reg + 1);
+                ins.b = reg + 1;
+            }
+            break;
+        }
+        m_code.push_back(ins);
+    }
+
+    namespace {
+
+        template<typename F>
+        inline void unary(int n, double* dst, const double* a, F f) {
+            #pragma omp simd
+            for (int k = 0; k < n; ++k) { dst[k] = f(a[k]); }
+        }
+
+        template<typename F>
+        inline void binary(int n, double* dst, const double* a, const double* b, F f) {
+            #pragma omp simd
+            for (int k = 0; k < n; ++k) { dst[k] = f(a[k], b[k]); }
+        }
+
+        inline void fill(int n, double* dst, double value) {
+            #pragma omp simd
+            for (int k = 0; k < n; ++k) { dst[k] = value; }
+        }
+
+    }
+
+    void Expression::compute(Op op, int n, double* d, const double* a, const double* b) {
+        switch (op) {
+        case Op::add:           binary(n, d, a, b, [](double p, double q) { return p + q; }); break;
+        case Op::sub:           binary(n, d, a, b, [](double p, double q) { return p - q; }); break;
+        case Op::mul:           binary(n, d, a, b, [](double p, double q) { return p * q; }); break;
+        case Op::div:           binary(n, d, a, b, [](double p, double q) { return p / q; }); break;
+        case Op::pow:           binary(n, d, a, b, [](double p, double q) { return std::pow(p, q); }); break;
+        case Op::atan2:         binary(n, d, a, b, [](double p, double q) { return std::atan2(p, q); }); break;
+        case Op::min:           binary(n, d, a, b, [](double p, double q) { return std::min(p, q); }); break;
+        case Op::max:           binary(n, d, a, b, [](double p, double q) { return std::max(p, q); }); break;
+        case Op::lt:            binary(n, d, a, b, [](double p, double q) { return p < q ? 1.0 : 0.0; }); break;
+        case Op::gt:            binary(n, d, a, b, [](double p, double q) { return p > q ? 1.0 : 0.0; }); break;
+        case Op::le:            binary(n, d, a, b, [](double p, double q) { return p <= q ? 1.0 : 0.0; }); break;
+        case Op::ge:            binary(n, d, a, b, [](double p, double q) { return p >= q ? 1.0 : 0.0; }); break;
+        case Op::eq:            binary(n, d, a, b, [](double p, double q) { return p == q ? 1.0 : 0.0; }); break;
+        case Op::ne:            binary(n, d, a, b, [](double p, double q) { return p != q ? 1.0 : 0.0; }); break;
+        case Op::logicalAnd:    binary(n, d, a, b, [](double p, double q) { return (p != 0.0 && q != 0.0) ? 1.0 : 0.0; }); break;
+        case Op::logicalOr:     binary(n, d, a, b, [](double p, double q) { return (p != 0.0 || q != 0.0) ? 1.0 : 0.0; }); break;
+        case Op::neg:           unary(n, d, a, [](double p) { return -p; }); break;
+        case Op::logicalNot:    unary(n, d, a, [](double p) { return p == 0.0 ? 1.0 : 0.0; }); break;
+        case Op::step:          unary(n, d, a, [](double p) { return p >= 0.0 ? 1.0 : 0.0; }); break;
+        case Op::sin:           unary(n, d, a, [](double p) { return std::sin(p); }); break;
+        case Op::cos:           unary(n, d, a, [](double p) { return std::cos(p); }); break;
+        case Op::tan:           unary(n, d, a, [](double p) { return std::tan(p); }); break;
+        case Op::asin:          unary(n, d, a, [](double p) { return std::asin(p); }); break;
+        case Op::acos:          unary(n, d, a, [](double p) { return std::acos(p); }); break;
+        case Op::atan:          unary(n, d, a, [](double p) { return std::atan(p); }); break;
+        case Op::sinh:          unary(n, d, a, [](double p) { return std::sinh(p); }); break;
+        case Op::cosh:          unary(n, d, a, [](double p) { return std::cosh(p); }); break;
+        case Op::tanh:          unary(n, d, a, [](double p) { return std::tanh(p); }); break;
+        case Op::exp:           unary(n, d, a, [](double p) { return std::exp(p); }); break;
+        case Op::log:           unary(n, d, a, [](double p) { return std::log(p); }); break;
+        case Op::log10:         unary(n, d, a, [](double p) { return std::log10(p); }); break;
+        case Op::sqrt:          unary(n, d, a, [](double p) { return std::sqrt(p); }); break;
+        case Op::abs:           unary(n, d, a, [](double p) { return std::abs(p); }); break;
+        case Op::floor:         unary(n, d, a, [](double p) { return std::floor(p); }); break;
+        case Op::ceil:          unary(n, d, a, [](double p) { return std::ceil(p); }); break;
+        default: break;         // leaves are handled by evaluate()
+        }
+    }
+
+    void Expression::evaluate(const Ensemble& ens, const int* particles, int n, double t, double* out) const {
+        if (!isValid()) {
+            std::fill(out, out + n, 0.0);
+            return;
+        }
+        // the register file of the calling thread, reused across calls and expressions
+        thread_local std::vector<double> registers;
+        size_t size = (size_t)m_nRegisters * s_chunkSize;
+        if (registers.size() < size) { registers.resize(size); }
+        // the schedules depend on time only, they are looked up once for all chunks
+        thread_local std::vector<double> scheduled;
+        scheduled.resize(m_schedules.size());
+        for (size_t i = 0; i < m_schedules.size(); ++i) { scheduled[i] = m_schedules[i]->value(t); }
+        for (int first = 0; first < n; first += s_chunkSize) {
+            evaluateChunk(registers.data(), scheduled.data(), ens, particles + first, std::min(s_chunkSize, n - first), t, out + first);
+        }
+    }
+
+    void Expression::evaluateChunk(double* base, const double* scheduled, const Ensemble& ens, const int* particles, int n, double t, double* out) const {
+        const double* pos = ens.pos.data();
+        const double* vel = ens.vel.data();
+        for (const Instruction& ins : m_code) {
+            double* d = base + (size_t)ins.dst * s_chunkSize;
+            switch (ins.op) {
+            case Op::constant:  fill(n, d, m_constants[ins.a]); break;
+            case Op::parameter: fill(n, d, *m_parameters[ins.a]); break;
+            case Op::schedule:  fill(n, d, scheduled[ins.a]); break;
+            case Op::time:      fill(n, d, t); break;
+            case Op::load: {
+                const double* src = (ins.a < MC_DIMS ? pos : vel) + ins.a % MC_DIMS;
+                for (int k = 0; k < n; ++k) { d[k] = src[(size_t)particles[k] * MC_DIMS]; }
+                break;
+            }
+            case Op::radius: case Op::speed: {
+                const double* src = ins.op == Op::radius ? pos : vel;
+                #pragma omp simd
+                for (int k = 0; k < n; ++k) {
+                    const double* s = src + (size_t)particles[k] * MC_DIMS;
+                    d[k] = std::sqrt(s[0] * s[0] + s[1] * s[1] + s[2] * s[2]);
+                }
+                break;
+            }
+            default:
+                compute(ins.op, n, d, base + (size_t)ins.a * s_chunkSize, base + (size_t)ins.b * s_chunkSize);
+                break;
+            }
+        }
+        const double* result = base + (size_t)m_result * s_chunkSize;
+        std::copy(result, result + n, out);
+    }
+
+}
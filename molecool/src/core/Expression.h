@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include "Ensemble.h"
+#include "SwitchingSchedule.h"
+
+namespace molecool {
+
+    // an arithmetic expression of the particle state, e.g. "-k*x" or "r > 0.01", compiled once into a small
+    // register-based bytecode that is evaluated over chunks of particles: every instruction is a loop over the chunk
+    // (vectorized by the compiler), so the per-particle cost is a few arithmetic operations and nothing is interpreted
+    // per particle, no Lua is involved after compilation
+    // variables: x, y, z, vx, vy, vz, r (distance from the origin), speed, t, and named parameters (resolved at compile
+    // time to the address of their value, so later changes, e.g. by a sweep, are seen), and named switching schedules
+    // (their value at t, looked up once per evaluation, not per particle)
+    // operators: + - * / ^ (power), unary - and !, comparisons < > <= >= == != and logical && || (true is 1, false 0)
+    // functions: sin cos tan asin acos atan atan2 sinh cosh tanh exp log log10 sqrt abs floor ceil min max pow step
+    class Expression
+    {
+    public:
+        // gives the address of a named parameter's value, or nullptr if there is no such parameter
+        using Resolver = std::function< const double*(const std::string& /*name*/) >;
+        // gives a named switching schedule, or nullptr if there is no such schedule
+        using ScheduleResolver = std::function< const SwitchingSchedule*(const std::string& /*name*/) >;
+
+        Expression(const std::string& source, const Resolver& resolve, const ScheduleResolver& resolveSchedule = nullptr);
+
+        inline bool isValid() const { return m_error.empty(); }
+        inline const std::string& getError() const { return m_error; }
+        inline const std::string& getSource() const { return m_source; }
+
+        // evaluate for the n particles particles[0...n), writing n values to out
+        void evaluate(const Ensemble& ens, const int* particles, int n, double t, double* out) const;
+
+        static constexpr int s_chunkSize = 256;         // particles per pass through the code, the registers stay in L1
+
+    private:
+        enum class Op {
+            constant, parameter, schedule, load, time, radius, speed,
+            add, sub, mul, div, pow, neg, logicalNot, lt, gt, le, ge, eq, ne, logicalAnd, logicalOr,
+            sin, cos, tan, asin, acos, atan, atan2, sinh, cosh, tanh, exp, log, log10, sqrt, abs, floor, ceil, min, max, step
+        };
+
+        // dst = op(a, b), or for leaves an index into m_constants/m_parameters/m_schedules, or the state component
+        struct Instruction {
+            Op op;
+            int dst, a, b;
+        };
+
+        struct Node;
+        using NodePtr = std::unique_ptr<Node>;
+
+        std::string m_source;
+        std::string m_error;
+        std::vector<Instruction> m_code;
+        std::vector<double> m_constants;
+        std::vector<const double*> m_parameters;
+        std::vector<const SwitchingSchedule*> m_schedules;
+        int m_nRegisters = 0;
+        int m_result = 0;
+
+        // parsing (recursive descent, see Expression.cpp) and code generation into registers reg, reg + 1, ...
+        struct Parser;
+        void emit(const Node& node, int reg);
+
+        // dst[k] = op(a[k], b[k]) for k < n, the semantics of the non-leaf operations (also used for constant folding)
+        static void compute(Op op, int n, double* dst, const double* a, const double* b);
+
+        // evaluate for n <= s_chunkSize particles, with the values of m_schedules at t
+        void evaluateChunk(double* registers, const double* scheduled, const Ensemble& ens, const int* particles, int n, double t, double* out) const;
+    };
+
+    using ExpressionPtr = std::shared_ptr<Expression>;
+
+}
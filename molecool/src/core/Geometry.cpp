@@ -0,0 +1,154 @@
+#include "mcpch.h"
+#include "Geometry.h"
+
+namespace molecool {
+
+    void Geometry::configure(int axis) {
+        m_axis = axis;
+    }
+
+    void Geometry::addAperture(const Aperture& aperture) {
+        MC_CORE_TRACE("Adding aperture at {0}", aperture.position);
+        m_apertures.push_back(aperture);
+        Aperture& ap = m_apertures.back();
+        if (ap.shape != ApertureShape::tube) { ap.end = ap.position; }
+        if (ap.end < ap.position) { std::swap(ap.position, ap.end); }
+    }
+
+    void Geometry::reset(const Ensemble& ens) {
+        size_t nSlots = ens.pos.size() / MC_DIMS;
+        m_previous.assign(nSlots * MC_DIMS, 0.0);
+        m_seen.assign(nSlots, 0);
+        m_lost.assign(nSlots, 0);
+    }
+
+    void Geometry::saveState(BinaryWriter& out) const {
+        out.write(m_previous);
+        out.write(m_seen);
+        out.write(m_lost);
+    }
+
+    void Geometry::loadState(BinaryReader& in) {
+        in.read(m_previous);
+        in.read(m_seen);
+        in.read(m_lost);
+    }
+
+    void Geometry::evaluate(const Ensemble& ens, const int* particles, int n, double t, double* stop) {
+        // the segments as structure of arrays, along the axis (s) and the transverse axes (u, v)
+        thread_local std::vector<double> segments;
+        segments.resize(7 * (size_t)n);
+        double* s0 = segments.data();
+        double* u0 = s0 + n, * v0 = u0 + n;
+        double* s1 = v0 + n, * u1 = s1 + n, * v1 = u1 + n;
+        double* hit = v1 + n;
+        int ia = m_axis, iu = (m_axis + 1) % MC_DIMS, iv = (m_axis + 2) % MC_DIMS;
+        double lo = std::numeric_limits<double>::infinity();
+        double hi = -std::numeric_limits<double>::infinity();
+        for (int j = 0; j < n; ++j) {
+            int i = particles[j];
+            const double* x = &ens.pos[(size_t)i * MC_DIMS];
+            double* prev = &m_previous[(size_t)i * MC_DIMS];
+            uint32_t generation = ens.getSlotGeneration(i) + 1;
+            if (m_seen[i] != generation) {
+                // first evaluation of the particle, an empty segment
+                m_seen[i] = generation;
+                m_lost[i] = 0;
+                std::copy(x, x + MC_DIMS, prev);
+            }
+            s0[j] = prev[ia]; u0[j] = prev[iu]; v0[j] = prev[iv];
+            s1[j] = x[ia]; u1[j] = x[iu]; v1[j] = x[iv];
+            std::copy(x, x + MC_DIMS, prev);
+            stop[j] = m_lost[i];
+            lo = std::min(lo, std::min(s0[j], s1[j]));
+            hi = std::max(hi, std::max(s0[j], s1[j]));
+        }
+
+        for (const auto& ap : m_apertures) {
+            if (ap.end < lo || ap.position > hi) { continue; }
+            test(ap, n, s0, u0, v0, s1, u1, v1, hit);
+            #pragma omp simd
+            for (int j = 0; j < n; ++j) { stop[j] = std::max(stop[j], hit[j]); }
+        }
+
+        for (int j = 0; j < n; ++j) {
+            m_lost[particles[j]] = stop[j] != 0.0;
+        }
+    }
+
+    namespace {
+
+        // the segments crossing a plate (their ends are on different sides, landing on it counts once) where the
+        // crossing point (relative to the aperture center) is not open
+        template <typename Open>
+        inline void plate(const Aperture& ap, int n, const double* s0, const double* u0, const double* v0,
+            const double* s1, const double* u1, const double* v1, double* hit, Open open)
+        {
+            const double p = ap.position;
+            #pragma omp simd
+            for (int j = 0; j < n; ++j) {
+                bool cross = (s0[j] < p) != (s1[j] < p);
+                double f = cross ? (p - s0[j]) / (s1[j] - s0[j]) : 0.0;
+                double uc = u0[j] + f * (u1[j] - u0[j]) - ap.u;
+                double vc = v0[j] + f * (v1[j] - v0[j]) - ap.v;
+                hit[j] = (cross && !open(uc, vc)) ? 1.0 : 0.0;
+            }
+        }
+
+    }
+
+    void Geometry::test(const Aperture& ap, int n, const double* s0, const double* u0, const double* v0,
+        const double* s1, const double* u1, const double* v1, double* hit)
+    {
+        if (ap.shape == ApertureShape::tube) {
+            // the part of the segment within [position, end], the squared radius along a segment is convex, so its
+            // maximum over that part is at one of the ends of the part
+            const double p = ap.position;
+            const double e = ap.end;
+            const double r2 = ap.a * ap.a;
+            #pragma omp simd
+            for (int j = 0; j < n; ++j) {
+                double ds = s1[j] - s0[j];
+                double inv = ds != 0.0 ? 1.0 / ds : 0.0;
+                bool within = s0[j] >= p && s0[j] <= e;
+                double fa = ds != 0.0 ? (p - s0[j]) * inv : (within ? 0.0 : 2.0);
+                double fb = ds != 0.0 ? (e - s0[j]) * inv : (within ? 1.0 : 2.0);
+                double f0 = std::max(0.0, std::min(fa, fb));
+                double f1 = std::min(1.0, std::max(fa, fb));
+                double du = u1[j] - u0[j], dv = v1[j] - v0[j];
+                double ua = u0[j] + f0 * du - ap.u, va = v0[j] + f0 * dv - ap.v;
+                double ub = u0[j] + f1 * du - ap.u, vb = v0[j] + f1 * dv - ap.v;
+                bool out = ua * ua + va * va > r2 || ub * ub + vb * vb > r2;
+                hit[j] = (f0 <= f1 && out) ? 1.0 : 0.0;
+            }
+            return;
+        }
+
+        const double a = ap.a, b = ap.b;
+        switch (ap.shape) {
+        case ApertureShape::circle:
+            plate(ap, n, s0, u0, v0, s1, u1, v1, hit, [=](double u, double v) { return u * u + v * v <= a * a; });
+            break;
+        case ApertureShape::rectangle:
+            plate(ap, n, s0, u0, v0, s1, u1, v1, hit, [=](double u, double v) { return std::abs(u) <= 0.5 * a && std::abs(v) <= 0.5 * b; });
+            break;
+        case ApertureShape::annulus:
+            plate(ap, n, s0, u0, v0, s1, u1, v1, hit, [=](double u, double v) { return u * u + v * v >= a * a && u * u + v * v <= b * b; });
+            break;
+        default:
+            plate(ap, n, s0, u0, v0, s1, u1, v1, hit, [](double u, double v) { return false; });
+            break;
+        }
+    }
+
+    ApertureShape Geometry::nameToShape(const std::string& name) {
+        if (name == "circle") { return ApertureShape::circle; }
+        if (name == "rectangle") { return ApertureShape::rectangle; }
+        if (name == "annulus") { return ApertureShape::annulus; }
+        if (name == "plane") { return ApertureShape::plane; }
+        if (name == "tube") { return ApertureShape::tube; }
+        MC_CORE_WARN("unknown aperture shape '{0}', using a circle", name);
+        return ApertureShape::circle;
+    }
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Ensemble.h"
+#include "Serialization.h"
+
+namespace molecool {
+
+    enum class ApertureShape {
+        circle,         // circular opening of radius a in a plate at position
+        rectangle,      // rectangular opening of width a and height b (along the first and second transverse axes)
+        annulus,        // ring-shaped opening with inner radius a and outer radius b
+        plane,          // solid plate, every particle crossing it is lost
+        tube            // cylinder of radius a from position to end, particles touching the wall are lost
+    };
+
+    // an aperture, placed along the beam axis, centered at (u, v) on the transverse axes
+    struct Aperture {
+        ApertureShape shape = ApertureShape::circle;
+        double position = 0.0;
+        double end = 0.0;                           // tubes only
+        double u = 0.0, v = 0.0;
+        double a = 0.0, b = 0.0;
+    };
+
+    // thin apertures and tubes, tested against the straight-line segment every particle moved along since its previous
+    // evaluation, so particles that jump across a plate within one timestep are still caught
+    // the tests run over structure-of-arrays copies of the segments, one loop per aperture (vectorized), apertures that do
+    // not overlap the axial extent of the segments are skipped, lost particles are reported as a chunk filter (see
+    // Thruster), which deactivates them
+    // the previous positions are kept per slot, a refilled slot (see Ensemble::getSlotGeneration) starts a new segment
+    class Geometry
+    {
+    public:
+        // axis 0, 1, 2 is x, y, z
+        void configure(int axis);
+        void addAperture(const Aperture& aperture);
+
+        // size the per-slot state for the ensemble and forget all segments, before propagating (not concurrently)
+        void reset(const Ensemble& ens);
+
+        // checkpoint support, the segments started before the checkpoint must be completed after resuming
+        void saveState(BinaryWriter& out) const;
+        void loadState(BinaryReader& in);
+
+        // chunk filter (see Thruster), a lost particle stays stopped until its slot is refilled
+        void evaluate(const Ensemble& ens, const int* particles, int n, double t, double* stop);
+
+        inline bool isEmpty() const { return m_apertures.empty(); }
+
+        static ApertureShape nameToShape(const std::string& name);
+
+    private:
+        int m_axis = 2;
+        std::vector<Aperture> m_apertures;
+        std::vector<double> m_previous;             // position at the previous evaluation, by slot
+        std::vector<uint32_t> m_seen;               // slot generation + 1 at the previous evaluation, 0 if none
+        std::vector<char> m_lost;                   // by slot
+
+        // set hit[j] for the segments (s0, u0, v0) -> (s1, u1, v1) that are stopped by the aperture
+        static void test(const Aperture& ap, int n, const double* s0, const double* u0, const double* v0,
+            const double* s1, const double* u1, const double* v1, double* hit);
+    };
+
+}
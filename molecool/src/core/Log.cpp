@@ -1,4 +1,5 @@
 #include "mcpch.h"
+#include "spdlog/async.h"
 
 namespace molecool {
 
@@ -10,12 +11,23 @@ namespace molecool {
         // timestamp, logger name, message
         //spdlog::set_pattern("%^[%T] %n: %v%$");
         spdlog::set_pattern("%^[%Y-%m-%d %T.%e] [%n] [%l] %v%$");
-        
-        s_coreLogger = spdlog::stdout_color_mt("MOLECOOL");    // core/engine logger
+
+        // one background thread writes the messages of both loggers, in order
+        spdlog::init_thread_pool(8192, 1);
+
+        s_coreLogger = spdlog::stdout_color_mt<spdlog::async_factory_nonblock>("MOLECOOL");    // core/engine logger
         s_coreLogger->set_level(spdlog::level::trace);
+        s_coreLogger->flush_on(spdlog::level::err);
         
-        s_clientLogger = spdlog::stdout_color_mt("SIM");       // client simulation logger
+        s_clientLogger = spdlog::stdout_color_mt<spdlog::async_factory_nonblock>("SIM");       // client simulation logger
         s_clientLogger->set_level(spdlog::level::trace);
+        s_clientLogger->flush_on(spdlog::level::err);
+    }
+
+    void Log::shutdown() {
+        if (s_coreLogger) { s_coreLogger->flush(); }
+        if (s_clientLogger) { s_clientLogger->flush(); }
+        spdlog::shutdown();
     }
 
 }
\ No newline at end of file
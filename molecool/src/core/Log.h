@@ -1,29 +1,83 @@
 #pragma once
 
 #include <memory>
+#include <atomic>
+#include <chrono>
 #include "Core.h"
 #include "spdlog/spdlog.h"
 
+// compile-time log level: calls below it are removed entirely (arguments are not evaluated)
+// 0 = trace, 1 = debug, 2 = info, 3 = warn, 4 = error, 5 = fatal
+#ifndef MC_LOG_ACTIVE_LEVEL
+#ifdef MC_RELEASE
+#define MC_LOG_ACTIVE_LEVEL 2
+#else
+#define MC_LOG_ACTIVE_LEVEL 0
+#endif
+#endif
+
 // core/engine logging macros
 #define MC_CORE_FATAL(...) molecool::Log::getCoreLogger()->critical(__VA_ARGS__)
 #define MC_CORE_ERROR(...) molecool::Log::getCoreLogger()->error(__VA_ARGS__)
 #define MC_CORE_INFO(...)  molecool::Log::getCoreLogger()->info(__VA_ARGS__)
 #define MC_CORE_WARN(...)  molecool::Log::getCoreLogger()->warn(__VA_ARGS__)
+#if MC_LOG_ACTIVE_LEVEL <= 1
+#define MC_CORE_DEBUG(...) molecool::Log::getCoreLogger()->debug(__VA_ARGS__)
+#else
+#define MC_CORE_DEBUG(...) (void)0
+#endif
+#if MC_LOG_ACTIVE_LEVEL <= 0
 #define MC_CORE_TRACE(...) molecool::Log::getCoreLogger()->trace(__VA_ARGS__)
+#else
+#define MC_CORE_TRACE(...) (void)0
+#endif
 
 // client logging macros
 #define MC_FATAL(...) molecool::Log::getClientLogger()->critical(__VA_ARGS__)
 #define MC_ERROR(...) molecool::Log::getClientLogger()->error(__VA_ARGS__)
 #define MC_INFO(...)  molecool::Log::getClientLogger()->info(__VA_ARGS__)
 #define MC_WARN(...)  molecool::Log::getClientLogger()->warn(__VA_ARGS__)
+#if MC_LOG_ACTIVE_LEVEL <= 1
+#define MC_DEBUG(...) molecool::Log::getClientLogger()->debug(__VA_ARGS__)
+#else
+#define MC_DEBUG(...) (void)0
+#endif
+#if MC_LOG_ACTIVE_LEVEL <= 0
 #define MC_TRACE(...) molecool::Log::getClientLogger()->trace(__VA_ARGS__)
+#else
+#define MC_TRACE(...) (void)0
+#endif
+
+// rate-limited logging for hot paths: each call site logs at most once per interval (seconds), messages
+// dropped in between are counted and reported with the next one that gets through, e.g.
+// MC_CORE_LIMITED(warn, 1.0, "particle {0} outside field map", i);
+#define MC_LOG_LIMITED(logger, lvl, interval, ...) do {															\
+		static ::molecool::LogRateLimiter mcLogLimiter(interval);													\
+		uint64_t mcSuppressed = 0;																					\
+		if (mcLogLimiter.allow(mcSuppressed)) {																		\
+			logger->log(spdlog::level::lvl, __VA_ARGS__);															\
+			if (mcSuppressed > 0) { logger->log(spdlog::level::lvl, "({0} similar messages suppressed)", mcSuppressed); }	\
+		}																											\
+	} while (0)
+#define MC_CORE_LIMITED(lvl, interval, ...) MC_LOG_LIMITED(molecool::Log::getCoreLogger(), lvl, interval, __VA_ARGS__)
+#define MC_LIMITED(lvl, interval, ...) MC_LOG_LIMITED(molecool::Log::getClientLogger(), lvl, interval, __VA_ARGS__)
+#if MC_LOG_ACTIVE_LEVEL <= 0
+#define MC_CORE_TRACE_LIMITED(interval, ...) MC_CORE_LIMITED(trace, interval, __VA_ARGS__)
+#else
+#define MC_CORE_TRACE_LIMITED(interval, ...) (void)0
+#endif
 
 namespace molecool {
 
     class  Log {
     public:
+        // loggers are asynchronous: messages are formatted on the calling thread and queued (bounded, the
+        // oldest messages are dropped when it is full, so logging never blocks), a background thread writes them
         static void init();
 
+        // drain the queue and stop the background thread
+        static void shutdown();
+
         // get logger methods, return shared_ptr by reference to avoid unnecessary reference counting on copy
         inline static std::shared_ptr<spdlog::logger>& getCoreLogger() { return s_coreLogger; }
         inline static std::shared_ptr<spdlog::logger>& getClientLogger() { return s_clientLogger; }
@@ -33,4 +87,57 @@ namespace molecool {
         static std::shared_ptr<spdlog::logger> s_clientLogger;
     };
 
+    // lets one message per interval through, thread-safe and lock-free
+    class LogRateLimiter {
+    public:
+        explicit LogRateLimiter(double interval)
+            : m_interval((int64_t)(interval * 1e9))
+        {}
+
+        // true if a message may be logged now, suppressed is then the number of messages dropped since the last one
+        bool allow(uint64_t& suppressed) {
+            int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            int64_t next = m_next.load(std::memory_order_relaxed);
+            if (now >= next && m_next.compare_exchange_strong(next, now + m_interval, std::memory_order_relaxed)) {
+                suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+                return true;
+            }
+            m_suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+    private:
+        int64_t m_interval;
+        std::atomic<int64_t> m_next{ 0 };
+        std::atomic<uint64_t> m_suppressed{ 0 };
+    };
+
+    // aggregates repeated hot-path events into a single message: threads only count (a relaxed atomic increment),
+    // and the owner of the loop reports the total afterwards, e.g. "1234 particles lost"
+    class LogCounter {
+    public:
+        LogCounter(const char* what, spdlog::level::level_enum level = spdlog::level::trace)
+            : m_what(what), m_level(level)
+        {}
+
+        inline void count(uint64_t n = 1) { m_count.fetch_add(n, std::memory_order_relaxed); }
+
+        // log and reset the count (if anything was counted) for simulation time t, the total count is kept
+        void report(double t) {
+            uint64_t n = m_count.exchange(0, std::memory_order_relaxed);
+            if (n == 0) { return; }
+            m_total += n;
+            if (m_level < MC_LOG_ACTIVE_LEVEL || !Log::getCoreLogger()) { return; }
+            Log::getCoreLogger()->log(m_level, "{0} {1} at t = {2} (total {3})", n, m_what, t, m_total);
+        }
+
+        inline uint64_t getTotal() const { return m_total + m_count.load(std::memory_order_relaxed); }
+
+    private:
+        const char* m_what;
+        spdlog::level::level_enum m_level;
+        std::atomic<uint64_t> m_count{ 0 };
+        uint64_t m_total = 0;
+    };
+
 }
@@ -0,0 +1,142 @@
+#include "mcpch.h"
+#include "LuaPool.h"
+
+namespace molecool {
+
+    ParticleBatch::ParticleBatch(const Ensemble& ens, const int* particles, int n, double* fx, double* fy, double* fz, double* stop)
+        : size(n), m_ensemble(ens), m_particles(particles), m_fx(fx), m_fy(fy), m_fz(fz), m_stop(stop)
+    {}
+
+    // Lua indices are 1-based, an index out of range raises a Lua error (sol turns the exception into one)
+    void ParticleBatch::check(int i) const {
+        if (i < 1 || i > size) { throw std::out_of_range("particle " + std::to_string(i) + " not in batch of " + std::to_string(size)); }
+    }
+
+    ParticleProxy ParticleBatch::particle(int i) const {
+        check(i);
+        return ParticleProxy(m_ensemble, m_particles[i - 1]);
+    }
+
+    void ParticleBatch::setForce(int i, const Force& f) {
+        check(i);
+        if (!m_fx) { throw std::logic_error("setForce() called from a filter"); }
+        m_fx[i - 1] = f.x;
+        m_fy[i - 1] = f.y;
+        m_fz[i - 1] = f.z;
+    }
+
+    void ParticleBatch::stop(int i) {
+        check(i);
+        if (!m_stop) { throw std::logic_error("stop() called from a force"); }
+        m_stop[i - 1] = 1.0;
+    }
+
+    std::atomic<int> LuaPool::s_nextId{ 0 };
+
+    LuaPool::LuaPool(const std::string& scriptFile, const Setup& setup)
+        : m_id(s_nextId++), m_scriptFile(scriptFile), m_setup(setup)
+    {
+        MC_CORE_TRACE("Creating Lua pool for {0}", scriptFile);
+    }
+
+    sol::state& LuaPool::local() {
+        return *getLocal().state;
+    }
+
+    LuaPool::Local& LuaPool::getLocal() {
+        // the states of the calling thread, by pool, a handful of entries at most
+        thread_local std::vector<std::pair<int, Local*>> states;
+        for (const auto& s : states) {
+            if (s.first == m_id) { return *s.second; }
+        }
+
+        // first call on this thread, the script runs outside the lock, states are independent
+        auto local = std::make_unique<Local>();
+        local->state = std::make_unique<sol::state>();
+        sol::state& state = *local->state;
+        state.open_libraries(sol::lib::base, sol::lib::math);
+        registerTypes(state);
+        if (m_setup) { m_setup(state); }
+        auto result = state.script_file(m_scriptFile, sol::script_pass_on_error);
+        if (!result.valid()) {
+            sol::error err = result;
+            MC_CORE_ERROR("Lua pool could not run {0}: {1}", m_scriptFile, err.what());
+        }
+
+        Local* ptr = local.get();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (const auto& g : m_globals) { state[g.first] = g.second; }
+            m_states.push_back(std::move(local));
+            MC_CORE_TRACE("Created Lua state {0} of pool", m_states.size());
+        }
+        states.emplace_back(m_id, ptr);
+        return *ptr;
+    }
+
+    void LuaPool::call(const std::string& function, const Ensemble& ens, const int* particles, int n, double t, double* fx, double* fy, double* fz, double* stop) {
+        for (double* out : { fx, fy, fz, stop }) {
+            if (out) { std::fill(out, out + n, 0.0); }
+        }
+        if (n == 0) { return; }
+
+        Local& local = getLocal();
+        auto it = local.functions.find(function);
+        if (it == local.functions.end()) {
+            sol::protected_function_result resolved = local.state->script("return " + function, sol::script_pass_on_error);
+            sol::protected_function f;
+            if (resolved.valid()) { f = resolved; }
+            it = local.functions.emplace(function, f).first;
+        }
+        ParticleBatch batch(ens, particles, n, fx, fy, fz, stop);
+        sol::protected_function_result result = it->second(std::ref(batch), t);
+        if (!result.valid()) {
+            sol::error err = result;
+            MC_CORE_LIMITED(err, 1.0, "scripted {0} threw {1}", function, err.what());
+        }
+    }
+
+    void LuaPool::setGlobal(const std::string& name, double value) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_globals[name] = value;
+        for (auto& local : m_states) { (*local->state)[name] = value; }
+    }
+
+    int LuaPool::getNumStates() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return (int)m_states.size();
+    }
+
+    void LuaPool::registerTypes(sol::state& lua) {
+        lua.new_usertype<Vector>("Vector",
+            sol::constructors<Vector(), Vector(double, double, double)>(),
+            "x", &Vector::x,
+            "y", &Vector::y,
+            "z", &Vector::z,
+            sol::meta_function::addition, [](const Vector& a, const Vector& b) { return a + b; },
+            sol::meta_function::subtraction, [](const Vector& a, const Vector& b) { return a - b; },
+            sol::meta_function::multiplication, [](const Vector& v, double d) { return v * d; },
+            sol::meta_function::division, [](const Vector& v, double d) { return v / d; }
+        );
+        lua.new_usertype<ParticleProxy>("ParticleProxy", sol::no_constructor,
+            "getIndex", &ParticleProxy::getIndex,
+            "getX", &ParticleProxy::getX,
+            "getY", &ParticleProxy::getY,
+            "getZ", &ParticleProxy::getZ,
+            "getVx", &ParticleProxy::getVx,
+            "getVy", &ParticleProxy::getVy,
+            "getVz", &ParticleProxy::getVz,
+            "getPos", &ParticleProxy::getPos,
+            "getVel", &ParticleProxy::getVel,
+            "isActive", &ParticleProxy::isActive,
+            "getMass", &ParticleProxy::getMass
+        );
+        lua.new_usertype<ParticleBatch>("ParticleBatch", sol::no_constructor,
+            "size", sol::readonly(&ParticleBatch::size),
+            "particle", &ParticleBatch::particle,
+            "setForce", &ParticleBatch::setForce,
+            "stop", &ParticleBatch::stop
+        );
+    }
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include "Ensemble.h"
+#include "sol/sol.hpp"
+
+namespace molecool {
+
+    // the particles passed to a scripted force or filter in one call (e.g. the active particles of a chunk), numbered
+    // 1...size in Lua, the function sets the forces on (or stops) particles of the batch, e.g.
+    // function(batch, t) for i = 1, batch.size do local p = batch:particle(i); batch:setForce(i, Vector(-p:getX(), 0, 0)) end end
+    class ParticleBatch
+    {
+    public:
+        ParticleBatch(const Ensemble& ens, const int* particles, int n, double* fx, double* fy, double* fz, double* stop);
+
+        const int size;
+
+        ParticleProxy particle(int i) const;
+        void setForce(int i, const Force& f);       // forces only
+        void stop(int i);                           // filters only
+
+    private:
+        const Ensemble& m_ensemble;
+        const int* m_particles;
+        double* m_fx, * m_fy, * m_fz, * m_stop;
+
+        void check(int i) const;
+    };
+
+    // Lua states for scripted physics in the parallel loops, one per thread (created on the thread's first call and kept,
+    // the scheduler's threads persist), each runs the simulation script, so the states hold the same functions and share
+    // nothing, a state only ever runs on its thread
+    // scripted forces and filters are functions in the script's 'forces'/'filters' arrays, called once per chunk with a
+    // ParticleBatch (see call()), so the interpreter is entered once per chunk rather than once per particle
+    class LuaPool
+    {
+    public:
+        // further setup of every new state before the script runs (e.g. globals the script needs)
+        using Setup = std::function< void(sol::state&) >;
+
+        LuaPool(const std::string& scriptFile, const Setup& setup = Setup());
+
+        // the state of the calling thread
+        sol::state& local();
+
+        // call a function of the script (a Lua expression, e.g. "forces[2]", resolved once per state) for the particles
+        // particles[0...n), the outputs (fx, fy, fz for forces, stop for filters, the others may be null) are zeroed first
+        void call(const std::string& function, const Ensemble& ens, const int* particles, int n, double t, double* fx, double* fy, double* fz, double* stop);
+
+        // set a global number in every state (e.g. a swept parameter), between parallel loops only
+        void setGlobal(const std::string& name, double value);
+
+        int getNumStates() const;
+
+        // usertypes for scripted physics: Vector, ParticleProxy and ParticleBatch, also used for the main state
+        static void registerTypes(sol::state& lua);
+
+    private:
+        // a thread's state, with the functions resolved in it (declared after the state, so they are released first)
+        struct Local {
+            std::unique_ptr<sol::state> state;
+            std::map<std::string, sol::protected_function> functions;
+        };
+
+        const int m_id;                             // identifies the pool in the threads' lookup of their states
+        std::string m_scriptFile;
+        Setup m_setup;
+        mutable std::mutex m_mutex;
+        std::vector<std::unique_ptr<Local>> m_states;           // guarded by m_mutex
+        std::map<std::string, double> m_globals;                // guarded by m_mutex
+
+        static std::atomic<int> s_nextId;
+
+        Local& getLocal();
+    };
+
+    using LuaPoolPtr = std::shared_ptr<LuaPool>;
+
+}
@@ -0,0 +1,45 @@
+#include "mcpch.h"
+#include "Memory.h"
+
+#if defined(MC_PLATFORM_LINUX)
+#include <sys/mman.h>
+#endif
+#if defined(MC_PLATFORM_WINDOWS)
+#include <malloc.h>
+#endif
+
+namespace molecool {
+
+    bool Memory::s_hugePages = false;
+
+    void* Memory::allocate(size_t bytes) {
+        if (bytes == 0) { return nullptr; }
+        bool huge = bytes >= s_hugePageThreshold;
+        size_t alignment = huge ? s_hugePageSize : s_alignment;
+        size_t size = (bytes + alignment - 1) / alignment * alignment;     // aligned_alloc requires a multiple of the alignment
+#if defined(MC_PLATFORM_WINDOWS)
+        void* p = _aligned_malloc(size, alignment);
+#else
+        void* p = std::aligned_alloc(alignment, size);
+#endif
+        if (!p) { throw std::bad_alloc(); }
+#if defined(MC_PLATFORM_LINUX) && defined(MADV_HUGEPAGE)
+        if (huge && s_hugePages) {
+            // transparent huge pages, the kernel falls back to regular pages if none are available
+            if (madvise(p, size, MADV_HUGEPAGE) != 0 && Log::getCoreLogger()) {
+                MC_CORE_WARN("huge pages unavailable for a {0} MB block", size >> 20);
+            }
+        }
+#endif
+        return p;
+    }
+
+    void Memory::deallocate(void* p, size_t bytes) {
+#if defined(MC_PLATFORM_WINDOWS)
+        _aligned_free(p);
+#else
+        std::free(p);
+#endif
+    }
+
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <vector>
+#include "Scheduler.h"
+
+namespace molecool {
+
+    // raw memory for large state arrays: cache-line aligned, and for big blocks aligned to (and, if enabled,
+    // backed by) transparent huge pages, which cuts TLB misses when streaming through large ensembles
+    class Memory {
+    public:
+        static void* allocate(size_t bytes);
+        static void deallocate(void* p, size_t bytes);
+
+        // initialize the elements [from, size) of v in parallel, partitioned like the particle loops (grain elements per particle)
+        template <class V>
+        static void firstTouch(V& v, size_t from, typename V::value_type value, int grain) {
+            if (from >= v.size()) { return; }
+            auto* data = v.data() + from;
+            Scheduler::get().parallelFor((long long)(v.size() - from), [&](long long begin, long long end, int worker) {
+                for (long long i = begin; i < end; ++i) { data[i] = value; }
+            }, grain);
+        }
+
+        // resize v to n elements, new elements set to value, if v has to grow its storage the copy of the old
+        // elements is made in parallel as well, so no page of the new storage is first touched by the calling thread
+        template <class V>
+        static void resizeFirstTouch(V& v, size_t n, typename V::value_type value, int grain) {
+            size_t old = v.size();
+            if (n <= v.capacity()) {
+                v.resize(n);
+                firstTouch(v, old, value, grain);
+                return;
+            }
+            V fresh(n);
+            const auto* src = v.data();
+            auto* dst = fresh.data();
+            Scheduler::get().parallelFor((long long)n, [&](long long begin, long long end, int worker) {
+                for (long long i = begin; i < end; ++i) { dst[i] = i < (long long)old ? src[i] : value; }
+            }, grain);
+            v.swap(fresh);
+        }
+
+        static inline void setHugePages(bool enable) { s_hugePages = enable; }
+        static inline bool isHugePages() { return s_hugePages; }
+
+        static constexpr size_t s_alignment = 64;                       // cache line
+        static constexpr size_t s_hugePageSize = 2 * 1024 * 1024;
+        static constexpr size_t s_hugePageThreshold = 16 * s_hugePageSize;  // smaller blocks are not worth a huge page
+
+    private:
+        static bool s_hugePages;
+    };
+
+    // allocator for the ensemble state vectors, placing pages on the NUMA node of the thread that first touches them
+    // value-initialization (e.g. by resize()) is turned into default-initialization, so allocating a vector does not
+    // touch its pages on the allocating thread; the owner must initialize new elements itself, in parallel, with the
+    // same partitioning as the computation (see firstTouch/resizeFirstTouch), so every page lands next to the core using it
+    template <class T>
+    class NumaAllocator {
+    public:
+        using value_type = T;
+
+        NumaAllocator() noexcept = default;
+        template <class U> NumaAllocator(const NumaAllocator<U>&) noexcept {}
+
+        T* allocate(size_t n) {
+            return static_cast<T*>(Memory::allocate(n * sizeof(T)));
+        }
+        void deallocate(T* p, size_t n) noexcept {
+            Memory::deallocate(p, n * sizeof(T));
+        }
+
+        template <class U>
+        void construct(U* p) noexcept(std::is_nothrow_default_constructible<U>::value) {
+            ::new((void*)p) U;                                      // default-, not value-initialization: no first touch
+        }
+        template <class U, class ...Args>
+        void construct(U* p, Args&&... args) {
+            ::new((void*)p) U(std::forward<Args>(args)...);
+        }
+
+        template <class U> bool operator==(const NumaAllocator<U>&) const noexcept { return true; }
+        template <class U> bool operator!=(const NumaAllocator<U>&) const noexcept { return false; }
+    };
+
+}
@@ -0,0 +1,140 @@
+#include "mcpch.h"
+#include "Optimizer.h"
+
+namespace molecool {
+
+    void Optimizer::addParameter(const Parameter& p) {
+        MC_CORE_TRACE("Optimizing parameter {0} in [{1}, {2}] from {3}", p.name, p.min, p.max, p.initial);
+        m_parameters.push_back(p);
+    }
+
+    std::vector<std::string> Optimizer::getNames() const {
+        std::vector<std::string> names;
+        for (const auto& p : m_parameters) { names.push_back(p.name); }
+        return names;
+    }
+
+    double Optimizer::evaluate(const Function& f, std::vector<double>& x, double threshold) {
+        for (size_t i = 0; i < x.size(); ++i) {
+            x[i] = std::clamp(x[i], m_parameters[i].min, m_parameters[i].max);
+        }
+        bool pruned = false;
+        double value = f(x, threshold, pruned);
+        m_pruned += pruned ? 1 : 0;
+        m_evaluations.push_back({ x, value, pruned });
+        if (value < m_bestValue) {
+            m_bestValue = value;
+            m_best = x;
+        }
+        MC_CORE_INFO("optimizer evaluation {0}: {1}{2}", m_evaluations.size(), value, pruned ? " (pruned)" : "");
+        return value;
+    }
+
+    std::vector<double> Optimizer::minimize(const Function& f) {
+        MC_PROFILE_FUNCTION();
+        const double inf = std::numeric_limits<double>::infinity();
+        const double alpha = 1.0, gamma = 2.0, rho = 0.5, sigma = 0.5;     // reflection, expansion, contraction, shrink
+        size_t n = m_parameters.size();
+        m_evaluations.clear();
+        m_bestValue = inf;
+        m_pruned = 0;
+
+        // initial simplex: the initial point, and one step along each parameter
+        std::vector<std::vector<double>> simplex(n + 1, std::vector<double>(n));
+        std::vector<double> values(n + 1);
+        for (size_t i = 0; i < n; ++i) { simplex[0][i] = m_parameters[i].initial; }
+        for (size_t v = 1; v <= n; ++v) {
+            simplex[v] = simplex[0];
+            simplex[v][v - 1] += m_parameters[v - 1].step;
+        }
+        for (size_t v = 0; v <= n; ++v) { values[v] = evaluate(f, simplex[v], inf); }
+
+        auto combine = [&](const std::vector<double>& a, const std::vector<double>& b, double c) {
+            std::vector<double> x(n);
+            for (size_t i = 0; i < n; ++i) { x[i] = a[i] + c * (b[i] - a[i]); }
+            return x;
+        };
+
+        while ((int)m_evaluations.size() < m_maxEvaluations) {
+            // order the vertices by value
+            std::vector<size_t> order(n + 1);
+            for (size_t v = 0; v <= n; ++v) { order[v] = v; }
+            std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return values[a] < values[b]; });
+            size_t best = order[0], worst = order[n], secondWorst = order[n - 1];
+            if (values[worst] - values[best] <= m_tolerance) { break; }
+
+            std::vector<double> centroid(n, 0.0);
+            for (size_t v = 0; v <= n; ++v) {
+                if (v == worst) { continue; }
+                for (size_t i = 0; i < n; ++i) { centroid[i] += simplex[v][i] / n; }
+            }
+
+            // reflection, which is only used if it beats the worst vertex
+            std::vector<double> reflected = combine(centroid, simplex[worst], -alpha);
+            double fr = evaluate(f, reflected, values[worst]);
+            if (fr < values[best]) {
+                // expansion, kept if it beats the reflection
+                std::vector<double> expanded = combine(centroid, simplex[worst], -gamma);
+                double fe = evaluate(f, expanded, fr);
+                if (fe < fr) { simplex[worst] = expanded; values[worst] = fe; }
+                else { simplex[worst] = reflected; values[worst] = fr; }
+                continue;
+            }
+            if (fr < values[secondWorst]) {
+                simplex[worst] = reflected;
+                values[worst] = fr;
+                continue;
+            }
+
+            // contraction, outside (towards the reflection) if that beat the worst vertex, else inside
+            bool outside = fr < values[worst];
+            std::vector<double> contracted = outside ? combine(centroid, reflected, rho) : combine(centroid, simplex[worst], rho);
+            double threshold = outside ? fr : values[worst];
+            double fc = evaluate(f, contracted, threshold);
+            if (fc < threshold) {
+                simplex[worst] = contracted;
+                values[worst] = fc;
+                continue;
+            }
+
+            // shrink towards the best vertex
+            for (size_t v = 0; v <= n; ++v) {
+                if (v == best) { continue; }
+                simplex[v] = combine(simplex[best], simplex[v], sigma);
+                values[v] = evaluate(f, simplex[v], inf);
+            }
+        }
+
+        MC_CORE_INFO("optimizer finished after {0} evaluations ({1} pruned), best value {2}", m_evaluations.size(), m_pruned, m_bestValue);
+        return m_best;
+    }
+
+    void Optimizer::write(const std::string& filename) const {
+        std::ofstream outputStream(filename);
+        if (!outputStream.is_open()) {
+            MC_CORE_ERROR("Optimizer could not open output file {0}", filename);
+            return;
+        }
+        auto writeValues = [&](const std::vector<double>& x) {
+            outputStream << "[";
+            for (size_t i = 0; i < x.size(); ++i) { outputStream << (i > 0 ? "," : "") << x[i]; }
+            outputStream << "]";
+        };
+        outputStream << std::scientific << std::setprecision(9);
+        outputStream << "{\"optimization\":{\"parameters\":[";
+        for (size_t i = 0; i < m_parameters.size(); ++i) {
+            outputStream << (i > 0 ? "," : "") << "\"" << m_parameters[i].name << "\"";
+        }
+        outputStream << "],\"best\":";
+        writeValues(m_best);
+        outputStream << ",\"bestValue\":" << m_bestValue << ",\"evaluations\":[";
+        for (size_t e = 0; e < m_evaluations.size(); ++e) {
+            const Evaluation& ev = m_evaluations[e];
+            outputStream << (e > 0 ? "," : "") << "{\"x\":";
+            writeValues(ev.x);
+            outputStream << ",\"value\":" << ev.value << ",\"pruned\":" << (ev.pruned ? "true" : "false") << "}";
+        }
+        outputStream << "]}}";
+    }
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <limits>
+
+namespace molecool {
+
+    // derivative-free minimization (Nelder-Mead simplex) over a few bounded parameters, for tuning e.g. timing sequences
+    // every evaluation is a full propagation, so the optimizer passes each candidate the value it has to beat: an
+    // evaluation may stop early and return any value >= threshold once the candidate is certain to be no better (pruning),
+    // the simplex steps are chosen such that the exact value of such a candidate is never needed
+    class Optimizer
+    {
+    public:
+        // evaluates the objective at x, may stop early (see above) and set pruned, threshold is infinite if the exact
+        // value is required
+        using Function = std::function< double(const std::vector<double>& /*x*/, double /*threshold*/, bool& /*pruned*/) >;
+
+        struct Parameter {
+            std::string name;
+            double initial;
+            double step;            // size of the initial simplex along this parameter
+            double min, max;
+        };
+
+        struct Evaluation {
+            std::vector<double> x;
+            double value;
+            bool pruned;
+        };
+
+        void addParameter(const Parameter& p);
+        inline void configure(int maxEvaluations, double tolerance) { m_maxEvaluations = maxEvaluations; m_tolerance = tolerance; }
+
+        inline bool isEmpty() const { return m_parameters.empty(); }
+        std::vector<std::string> getNames() const;
+
+        // minimize f, returns the best parameter values found
+        std::vector<double> minimize(const Function& f);
+
+        inline double getBestValue() const { return m_bestValue; }
+        inline const std::vector<Evaluation>& getEvaluations() const { return m_evaluations; }
+
+        // the evaluation history and the optimum as JSON
+        void write(const std::string& filename) const;
+
+    private:
+        std::vector<Parameter> m_parameters;
+        int m_maxEvaluations = 100;
+        double m_tolerance = 1e-6;          // stop when the values at the simplex vertices agree to within this (absolute)
+
+        std::vector<Evaluation> m_evaluations;
+        std::vector<double> m_best;
+        double m_bestValue = std::numeric_limits<double>::infinity();
+        int m_pruned = 0;
+
+        // clamps x to the parameter bounds (in place, so the simplex holds the evaluated point) and evaluates it
+        double evaluate(const Function& f, std::vector<double>& x, double threshold);
+    };
+
+}
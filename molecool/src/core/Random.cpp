@@ -21,8 +21,24 @@ namespace molecool {
 
     VSLStreamStatePtr RandomStream::getStream() { return m_stream; }
 
+    void RandomStream::saveState(BinaryWriter& out) const {
+        std::vector<char> state(vslGetStreamSize(m_stream));
+        checkStatus(vslSaveStreamM(m_stream, state.data()));
+        out.write(m_id);
+        out.write(state);
+    }
+
+    void RandomStream::loadState(BinaryReader& in) {
+        std::vector<char> state;
+        in.read(m_id);
+        in.read(state);
+        if (!in || state.empty()) { return; }
+        vslDeleteStream(&m_stream);
+        checkStatus(vslLoadStreamM(&m_stream, state.data()));
+    }
+
     // TODO: report actual error using magic_enum?
-    void RandomStream::checkStatus(int status) {
+    void RandomStream::checkStatus(int status) const {
         if (status) { MC_CORE_ERROR("stream generation failed"); }
     }
 
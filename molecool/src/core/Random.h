@@ -40,6 +40,7 @@ Usage examples of Dist class:
 #include <time.h>
 #include <memory>
 #include "Core.h"
+#include "Serialization.h"
 
 namespace molecool {
 
@@ -54,13 +55,17 @@ namespace molecool {
         ~RandomStream();
         VSLStreamStatePtr getStream();
 
+        // checkpoint support, restores the exact position in the stream
+        void saveState(BinaryWriter& out) const;
+        void loadState(BinaryReader& in);
+
     private:
 
         VSLStreamStatePtr m_stream = nullptr;
         const int maxStreamId = 6024;
         static int s_streamId;
         int m_id;
-        void checkStatus(int status);
+        void checkStatus(int status) const;
     };
 
     // Random number generator types
@@ -0,0 +1,229 @@
+#include "mcpch.h"
+#include "Scheduler.h"
+
+#if defined(MC_PLATFORM_LINUX)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace molecool {
+
+    Scheduler::Scheduler()
+    {}
+
+    Scheduler::~Scheduler() {
+        stopWorkers();
+    }
+
+    Scheduler& Scheduler::get() {
+        static Scheduler instance;
+        return instance;
+    }
+
+    void Scheduler::configure(SchedulerPolicy policy, int nThreads, int chunkSize, bool pin) {
+        stopWorkers();
+        m_policy = policy;
+        m_chunkSize = chunkSize > 0 ? chunkSize : s_defaultChunkSize;
+        m_pin = pin;
+        int nWorkers = nThreads > 0 ? nThreads : omp_get_max_threads();
+        if (m_policy == SchedulerPolicy::native) {
+            startWorkers(nWorkers);
+        }
+        else {
+            if (nThreads > 0) { omp_set_num_threads(nThreads); }
+            if (m_pin) {
+                // the OpenMP runtime keeps its threads (and thread numbers) for later parallel regions of the same size
+                #pragma omp parallel
+                {
+                    pinCurrentThread(omp_get_thread_num());
+                }
+            }
+        }
+        MC_CORE_TRACE("Scheduler: {0} policy, {1} workers, {2} particles per chunk{3}", m_policy == SchedulerPolicy::native ? "native" : "openmp",
+            nWorkers, m_chunkSize, m_pin ? ", pinned" : "");
+    }
+
+    int Scheduler::getNumWorkers() const {
+        return m_policy == SchedulerPolicy::native ? (int)m_shares.size() : omp_get_max_threads();
+    }
+
+    void Scheduler::startWorkers(int nWorkers) {
+        m_shares = std::vector<Share>(std::max(1, nWorkers));
+        uint64_t epoch;
+        {
+            std::lock_guard lock(m_mutex);
+            m_stop = false;
+            m_busy = 0;
+            epoch = m_epoch;
+        }
+        // the workers start from the current epoch, a loop started before a worker first waits is not missed
+        for (int w = 1; w < nWorkers; ++w) {
+            m_threads.emplace_back(&Scheduler::workerLoop, this, w, epoch);
+        }
+        if (m_pin) { pinCurrentThread(0); }
+    }
+
+    // bind the calling thread to a core, worker w runs on core w (wrapping around)
+    void Scheduler::pinCurrentThread(int worker) {
+#if defined(MC_PLATFORM_LINUX)
+        int nCores = std::max(1, (int)std::thread::hardware_concurrency());
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(worker % nCores, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            MC_CORE_WARN("Scheduler could not pin worker {0}", worker);
+        }
+#else
+        if (worker == 0) { MC_CORE_WARN("Scheduler: thread pinning is not supported on this platform"); }
+#endif
+    }
+
+    void Scheduler::stopWorkers() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto& thread : m_threads) { thread.join(); }
+        m_threads.clear();
+        m_shares.clear();
+        m_stop = false;
+    }
+
+    void Scheduler::parallelFor(long long n, const RangeFunction& f, int grain) {
+        if (n <= 0) { return; }
+        grain = std::max(1, grain);
+
+        if (m_policy == SchedulerPolicy::openmp) {
+            // contiguous blocks of whole particles, one per thread (the same as static scheduling)
+            long long nUnits = (n + grain - 1) / grain;
+            #pragma omp parallel
+            {
+                long long nThreads = omp_get_num_threads();
+                long long id = omp_get_thread_num();
+                long long begin = std::min(n, (nUnits * id / nThreads) * grain);
+                long long end = std::min(n, (nUnits * (id + 1) / nThreads) * grain);
+                if (begin < end) { f(begin, end, (int)id); }
+            }
+            return;
+        }
+
+        int nWorkers = (int)m_shares.size();
+        long long elementsPerChunk = (long long)m_chunkSize * grain;
+        long long nChunks = (n + elementsPerChunk - 1) / elementsPerChunk;
+        if (nWorkers <= 1 || nChunks <= 1) {
+            f(0, n, 0);
+            return;
+        }
+        if (nChunks > std::numeric_limits<uint32_t>::max()) {
+            // chunk indices must fit the packed ranges
+            elementsPerChunk = ((n / std::numeric_limits<uint32_t>::max()) / grain + 1) * grain;
+            nChunks = (n + elementsPerChunk - 1) / elementsPerChunk;
+        }
+
+        // every worker starts with a contiguous share of the chunks
+        for (int w = 0; w < nWorkers; ++w) {
+            uint32_t begin = (uint32_t)(nChunks * w / nWorkers);
+            uint32_t end = (uint32_t)(nChunks * (w + 1) / nWorkers);
+            m_shares[w].range.store(pack(begin, end), std::memory_order_relaxed);
+        }
+        m_remaining.store(nChunks, std::memory_order_relaxed);
+        {
+            std::lock_guard lock(m_mutex);
+            m_job = &f;
+            m_n = n;
+            m_elementsPerChunk = elementsPerChunk;
+            m_busy = nWorkers - 1;
+            m_epoch++;
+        }
+        m_wake.notify_all();
+
+        work(0);
+
+        // the loop is complete, but the job must outlive every worker's last look at it
+        std::unique_lock lock(m_mutex);
+        m_done.wait(lock, [this] { return m_busy == 0; });
+        m_job = nullptr;
+    }
+
+    void Scheduler::workerLoop(int worker, uint64_t seen) {
+        if (m_pin) { pinCurrentThread(worker); }
+        while (true) {
+            {
+                std::unique_lock lock(m_mutex);
+                m_wake.wait(lock, [&] { return m_stop || m_epoch != seen; });
+                if (m_stop) { return; }
+                seen = m_epoch;
+            }
+            work(worker);
+            {
+                std::lock_guard lock(m_mutex);
+                if (--m_busy == 0) { m_done.notify_one(); }
+            }
+        }
+    }
+
+    void Scheduler::work(int worker) {
+        const RangeFunction& f = *m_job;
+        while (m_remaining.load(std::memory_order_acquire) > 0) {
+            uint32_t chunk;
+            while (popChunk(worker, chunk)) {
+                long long begin = chunk * m_elementsPerChunk;
+                long long end = std::min(m_n, begin + m_elementsPerChunk);
+                f(begin, end, worker);
+                m_remaining.fetch_sub(1, std::memory_order_acq_rel);
+            }
+            if (!steal(worker)) {
+                // nothing left to steal, the last chunks are being processed elsewhere
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // take the next chunk from the front of the worker's own share
+    bool Scheduler::popChunk(int worker, uint32_t& chunk) {
+        std::atomic<uint64_t>& range = m_shares[worker].range;
+        uint64_t current = range.load(std::memory_order_relaxed);
+        while (true) {
+            uint32_t begin = getBegin(current);
+            uint32_t end = getEnd(current);
+            if (begin >= end) { return false; }
+            if (range.compare_exchange_weak(current, pack(begin + 1, end), std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                chunk = begin;
+                return true;
+            }
+        }
+    }
+
+    // take the back half of another worker's remaining chunks, the worker's own share must be empty
+    // a chunk is only ever in one share, so equal packed values always describe the same chunks (no ABA problem)
+    bool Scheduler::steal(int worker) {
+        int nWorkers = (int)m_shares.size();
+        for (int k = 1; k < nWorkers; ++k) {
+            int victim = (worker + k) % nWorkers;
+            std::atomic<uint64_t>& range = m_shares[victim].range;
+            uint64_t current = range.load(std::memory_order_relaxed);
+            while (true) {
+                uint32_t begin = getBegin(current);
+                uint32_t end = getEnd(current);
+                if (begin >= end) { break; }
+                uint32_t split = end - (end - begin + 1) / 2;
+                if (range.compare_exchange_weak(current, pack(begin, split), std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                    m_shares[worker].range.store(pack(split, end), std::memory_order_release);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    SchedulerPolicy Scheduler::nameToPolicy(std::string name) {
+        if (name == "openmp") { return SchedulerPolicy::openmp; }
+        else if (name == "native") { return SchedulerPolicy::native; }
+        else {
+            MC_CORE_WARN("scheduler policy {0} not recognized, using openmp", name);
+            return SchedulerPolicy::openmp;
+        }
+    }
+
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <string>
+
+namespace molecool {
+
+    // processes the elements [begin, end) of a parallel loop, worker is the index of the executing worker (0...workers-1)
+    using RangeFunction = std::function< void(long long /*begin*/, long long /*end*/, int /*worker*/) >;
+
+    enum class SchedulerPolicy {
+        openmp,     // OpenMP parallel region, contiguous (static) blocks per thread
+        native      // persistent worker threads with work stealing over cache-sized chunks
+    };
+
+    // the execution layer for the parallel loops over particles (forces, integrator, observers)
+    // the native policy keeps a pool of persistent workers alive across steps, a loop is cut into chunks, and
+    // each worker starts on its own contiguous share of the chunks (as with static scheduling, for locality)
+    // a worker that runs out of chunks steals half of the remaining chunks of another worker, so uneven
+    // per-particle costs (dead particles, expensive field regions) no longer leave cores idle at the end of a loop
+    // each worker's share is a packed [begin, end) pair in a single 64 bit atomic, owner and thieves update it
+    // with compare-and-swap, no locks are taken while a loop runs
+    class Scheduler
+    {
+    public:
+        ~Scheduler();
+
+        static Scheduler& get();
+
+        // nThreads <= 0 uses all (OpenMP) threads, chunkSize <= 0 uses the default, pinning binds workers (or OpenMP
+        // threads) to cores (Linux), so the threads touching a part of the ensemble first keep working on it
+        void configure(SchedulerPolicy policy, int nThreads = 0, int chunkSize = 0, bool pin = false);
+
+        // run f over [0, n) in parallel and wait for completion, grain is the number of elements per particle
+        // (e.g. MC_DIMS for state vectors), so chunks hold the same number of particles for every loop
+        void parallelFor(long long n, const RangeFunction& f, int grain = 1);
+
+        inline SchedulerPolicy getPolicy() const { return m_policy; }
+        int getNumWorkers() const;
+
+        static SchedulerPolicy nameToPolicy(std::string name);
+
+        static constexpr int s_defaultChunkSize = 1024;     // particles per chunk, a few tens of kB of state, fits in L2
+
+    private:
+        Scheduler();
+        Scheduler(const Scheduler&) = delete;
+        Scheduler& operator=(const Scheduler&) = delete;
+
+        // a worker's share of the current loop, in units of chunks, padded to avoid false sharing
+        struct alignas(64) Share {
+            std::atomic<uint64_t> range{ 0 };       // begin in the high, end in the low 32 bits
+        };
+
+        static inline uint64_t pack(uint32_t begin, uint32_t end) { return ((uint64_t)begin << 32) | end; }
+        static inline uint32_t getBegin(uint64_t range) { return (uint32_t)(range >> 32); }
+        static inline uint32_t getEnd(uint64_t range) { return (uint32_t)range; }
+
+        SchedulerPolicy m_policy = SchedulerPolicy::openmp;
+        int m_chunkSize = s_defaultChunkSize;
+        bool m_pin = false;
+
+        // native pool, worker 0 is the calling thread
+        std::vector<std::thread> m_threads;
+        std::vector<Share> m_shares;
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::condition_variable m_done;
+        uint64_t m_epoch = 0;                       // incremented for every loop, guarded by m_mutex
+        int m_busy = 0;                             // workers still inside the current loop, guarded by m_mutex
+        bool m_stop = false;
+
+        // the current loop, published under m_mutex
+        const RangeFunction* m_job = nullptr;
+        long long m_n = 0;
+        long long m_elementsPerChunk = 1;
+        std::atomic<long long> m_remaining{ 0 };    // chunks not yet processed
+
+        void startWorkers(int nWorkers);
+        void stopWorkers();
+        void workerLoop(int worker, uint64_t seen);     // seen is the epoch when the worker was started
+        void work(int worker);
+        bool popChunk(int worker, uint32_t& chunk);
+        bool steal(int worker);
+        static void pinCurrentThread(int worker);
+    };
+
+}
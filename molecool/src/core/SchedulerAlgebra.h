@@ -0,0 +1,35 @@
+#pragma once
+
+#include <tuple>
+#include <boost/range.hpp>
+#include "Core.h"
+#include "Scheduler.h"
+
+namespace molecool {
+
+    // an odeint algebra for random access state ranges that runs its element-wise operations through the
+    // Scheduler, so the integrator uses the same execution layer (and chunking) as the force evaluation
+    // chunks are cut at particle boundaries (MC_DIMS elements), i.e. a chunk covers the same particles in every loop
+    struct scheduler_range_algebra
+    {
+        template< class S0, class Op > static void for_each1(S0& s0, Op op) { forEach(op, s0); }
+        template< class S0, class S1, class Op > static void for_each2(S0& s0, S1& s1, Op op) { forEach(op, s0, s1); }
+        template< class S0, class S1, class S2, class Op > static void for_each3(S0& s0, S1& s1, S2& s2, Op op) { forEach(op, s0, s1, s2); }
+        template< class S0, class S1, class S2, class S3, class Op > static void for_each4(S0& s0, S1& s1, S2& s2, S3& s3, Op op) { forEach(op, s0, s1, s2, s3); }
+        template< class S0, class S1, class S2, class S3, class S4, class Op > static void for_each5(S0& s0, S1& s1, S2& s2, S3& s3, S4& s4, Op op) { forEach(op, s0, s1, s2, s3, s4); }
+        template< class S0, class S1, class S2, class S3, class S4, class S5, class Op > static void for_each6(S0& s0, S1& s1, S2& s2, S3& s3, S4& s4, S5& s5, Op op) { forEach(op, s0, s1, s2, s3, s4, s5); }
+
+    private:
+        template< class Op, class S0, class ...S >
+        static void forEach(Op& op, S0& s0, S&... s) {
+            const long long len = (long long)boost::size(s0);
+            auto begins = std::make_tuple(boost::begin(s0), boost::begin(s)...);
+            Scheduler::get().parallelFor(len, [&](long long begin, long long end, int worker) {
+                std::apply([&](auto... its) {
+                    for (long long i = begin; i < end; ++i) { op(its[i]...); }
+                }, begins);
+            }, MC_DIMS);
+        }
+    };
+
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+namespace molecool {
+
+    // minimal binary serialization into an in-memory buffer, used for checkpoints
+    // values are written in native byte order, so buffers are only meant to be read back on the same platform
+    class BinaryWriter {
+    public:
+        template <typename T>
+        void write(const T& value) {
+            static_assert(std::is_trivially_copyable<T>::value, "BinaryWriter can only write trivially copyable types");
+            append(&value, sizeof(T));
+        }
+
+        template <typename A, typename B>
+        void write(const std::pair<A, B>& p) {
+            write(p.first);
+            write(p.second);
+        }
+
+        void write(const std::string& s) {
+            write<uint64_t>(s.size());
+            append(s.data(), s.size());
+        }
+
+        template <typename T, typename Alloc>
+        void write(const std::vector<T, Alloc>& v) {
+            write<uint64_t>(v.size());
+            if constexpr (std::is_trivially_copyable<T>::value) {
+                append(v.data(), v.size() * sizeof(T));
+            }
+            else {
+                for (const auto& e : v) { write(e); }
+            }
+        }
+
+        inline std::vector<char>& getBuffer() { return m_buffer; }
+
+    private:
+        std::vector<char> m_buffer;
+
+        void append(const void* data, size_t n) {
+            const char* bytes = (const char*)data;
+            m_buffer.insert(m_buffer.end(), bytes, bytes + n);
+        }
+    };
+
+    // reads back what a BinaryWriter wrote, in the same order
+    // reading past the end of the buffer leaves the target untouched and puts the reader in a failed state
+    class BinaryReader {
+    public:
+        BinaryReader(const std::vector<char>& buffer, size_t offset = 0)
+            : m_buffer(buffer), m_pos(offset)
+        {}
+
+        template <typename T>
+        void read(T& value) {
+            static_assert(std::is_trivially_copyable<T>::value, "BinaryReader can only read trivially copyable types");
+            extract(&value, sizeof(T));
+        }
+
+        template <typename A, typename B>
+        void read(std::pair<A, B>& p) {
+            read(p.first);
+            read(p.second);
+        }
+
+        void read(std::string& s) {
+            uint64_t n = 0;
+            read(n);
+            if (!checkSize(n)) { return; }
+            s.assign(&m_buffer[m_pos], n);
+            m_pos += n;
+        }
+
+        template <typename T, typename Alloc>
+        void read(std::vector<T, Alloc>& v) {
+            uint64_t n = 0;
+            read(n);
+            if constexpr (std::is_trivially_copyable<T>::value) {
+                if (!checkSize(n * sizeof(T))) { return; }
+                v.resize(n);
+                extract(v.data(), n * sizeof(T));
+            }
+            else {
+                v.resize(n);
+                for (auto& e : v) { read(e); }
+            }
+        }
+
+        // the number of elements of the vector of T about to be read (0 if it cannot be read), e.g. to size the target
+        // in a particular way before reading into it
+        template <typename T>
+        uint64_t peekCount() const {
+            uint64_t n = 0;
+            if (!m_good || sizeof(n) > m_buffer.size() - m_pos) { return 0; }
+            std::memcpy(&n, &m_buffer[m_pos], sizeof(n));
+            return n <= (m_buffer.size() - m_pos - sizeof(n)) / sizeof(T) ? n : 0;
+        }
+
+        // true while all reads have succeeded
+        inline bool isGood() const { return m_good; }
+        inline explicit operator bool() const { return m_good; }
+
+    private:
+        const std::vector<char>& m_buffer;
+        size_t m_pos;
+        bool m_good = true;
+
+        bool checkSize(uint64_t n) {
+            if (!m_good || n > m_buffer.size() - m_pos) { m_good = false; }
+            return m_good;
+        }
+
+        void extract(void* data, size_t n) {
+            if (!checkSize(n)) { return; }
+            if (n > 0) { std::memcpy(data, &m_buffer[m_pos], n); }
+            m_pos += n;
+        }
+    };
+
+}
@@ -1,7 +1,12 @@
 #include "mcpch.h"
 #include "Simulation.h"
+#include "SchedulerAlgebra.h"
+#include <filesystem>
 #include "assets/observers/Trajectorizer.h"
 #include "assets/observers/Staticizer.h"
+#include "assets/observers/Momentizer.h"
+#include "assets/observers/Histogrammer.h"
+#include "assets/observers/Detectorizer.h"
 
 #define SOL_ALL_SAFETIES_ON 1
 #include "sol/sol.hpp"
@@ -22,12 +27,220 @@ namespace molecool {
     void Simulation::run() {
         MC_PROFILE_FUNCTION();
         parseScript();
+        if (batchSize > 0) {
+            runBatches();
+            return;
+        }
+        if (!sweep.isEmpty()) {
+            runSweep();
+            return;
+        }
+        if (!optimizer.isEmpty()) {
+            runOptimization();
+            return;
+        }
+        // the initial ensemble was not sampled if there is a checkpoint to resume from
+        m_resumed = checkpointer.isResumeRequested() && checkpointer.exists();
+        if (m_resumed && !restoreCheckpoint()) {
+            MC_CORE_FATAL("checkpoint could not be read, exiting...");
+            exit(-1);
+        }
+        if (!m_resumed) { ensemble.save("initials"); }
+        if (propagate()) {
+            ensemble.save("finals");
+        }
+    }
+
+    // out-of-core propagation: every batch is sampled into the (recycled) ensemble storage and propagated from tStart
+    // to tEnd, the observers fold its results into those of the previous batches, and its states are appended to the
+    // output files, so only one batch is ever held in memory
+    // the particles are independent, so the results are those of propagating the whole ensemble at once
+    // with convergence observables, the population is a budget: batches are propagated until the observables are known to
+    // the target error (or the budget, in particles or wall-clock time, is used up)
+    void Simulation::runBatches() {
+        MC_PROFILE_FUNCTION();
+        long long nBatches = (m_totalPopulation + batchSize - 1) / batchSize;
+        MC_CORE_INFO("propagating {0} particles in {1} batches of up to {2}", m_totalPopulation, nBatches, batchSize);
+        if (convergence.isEnabled()) {
+            MC_CORE_INFO("stopping early once the convergence observables have converged");
+            convergence.start();
+        }
+
+        std::ofstream initials, finals;
+        if (saveBatchStates) {
+            initials.open("output/initials.json");
+            finals.open("output/finals.json");
+            if (!initials.is_open() || !finals.is_open()) {
+                MC_CORE_ERROR("batch states could not be saved, output files could not be opened");
+                saveBatchStates = false;
+            }
+            else {
+                initials << std::fixed << std::setprecision(6) << "{\"initials\":[";
+                finals << std::fixed << std::setprecision(6) << "{\"finals\":[";
+            }
+        }
+
+        bool initialsEmpty = true, finalsEmpty = true;  // a batch may end without particles, so the first entry may come later
+        for (long long batch = 0; batch < nBatches; ++batch) {
+            long long first = batch * batchSize;
+            int n = (int)std::min<long long>(batchSize, m_totalPopulation - first);
+            ensemble.clear();
+            addParticles(n, ParticleId::CaF, m_initialDists[0], m_initialDists[1], m_initialDists[2], m_initialDists[3], m_initialDists[4], m_initialDists[5]);
+            watcher.beginBatch(batch, first);
+            if (saveBatchStates) { ensemble.writeStates(initials, initialsEmpty); }
+
+            propagate();
+
+            if (saveBatchStates) { ensemble.writeStates(finals, finalsEmpty); }
+            MC_CORE_INFO("batch {0}/{1} complete, {2} of {3} particles still active", batch + 1, nBatches, ensemble.getPopulation(), n);
+
+            if (convergence.isEnabled()) {
+                convergence.addBatch(ensemble, n);
+                if (convergence.isConverged()) {
+                    MC_CORE_INFO("observables converged after {0} batches ({1} particles)", batch + 1, first + n);
+                    break;
+                }
+                if (convergence.isOutOfTime()) {
+                    MC_CORE_WARN("time budget used up after {0} batches, observables have not converged", batch + 1);
+                    break;
+                }
+                if (batch + 1 == nBatches) {
+                    MC_CORE_WARN("particle budget used up, observables have not converged");
+                }
+            }
+        }
+        if (convergence.isEnabled()) { convergence.write("output/convergence.json"); }
+
+        if (saveBatchStates) {
+            initials << "]}";
+            finals << "]}";
+        }
+    }
+
+    // parameter sweeps: the points are propagated back to back (each using all threads) from the same initial ensemble,
+    // which is sampled once and restored for every point, the forces (and any data they hold) are set up once and shared
+    // by all points, which only differ in the parameter values, so a point costs little more than its propagation
+    // the results of every point are written to output/sweep/<point>/, and indexed with the parameter values in output/sweep.json
+    void Simulation::runSweep() {
+        MC_PROFILE_FUNCTION();
+        std::vector<std::string> names = sweep.getNames();
+        long long nPoints = sweep.getNumPoints();
+        MC_CORE_INFO("sweeping {0} parameters over {1} points", names.size(), nPoints);
+
+        saveInitialState();
+        ensemble.save("initials");
+        watcher.setWriteOnDestruction(false);
+
+        std::ofstream index("output/sweep.json");
+        if (!index.is_open()) {
+            MC_CORE_ERROR("sweep index file could not be opened");
+        }
+        index << std::scientific << std::setprecision(6) << "{\"sweep\":{\"parameters\":[";
+        for (size_t a = 0; a < names.size(); ++a) {
+            index << (a > 0 ? "," : "") << "\"" << names[a] << "\"";
+        }
+        index << "],\"points\":[";
+
+        for (long long p = 0; p < nPoints; ++p) {
+            std::vector<double> values = sweep.getPoint(p);
+            setParameters(names, values);
+            restoreInitialState();
+            propagate();
+
+            std::ostringstream name;
+            name << "sweep/" << std::setw(5) << std::setfill('0') << p;
+            std::string dir = "output/" + name.str();
+            std::filesystem::create_directories(dir);
+            ensemble.save("finals", dir);
+            watcher.writeResults(dir);
+            watcher.resetObservers();
+
+            index << (p > 0 ? "," : "") << "{\"index\":" << p << ",\"values\":[";
+            for (size_t a = 0; a < values.size(); ++a) {
+                index << (a > 0 ? "," : "") << values[a];
+            }
+            index << "],\"population\":" << ensemble.getPopulation() << ",\"dir\":\"" << name.str() << "\"}";
+            MC_CORE_INFO("sweep point {0}/{1} complete, {2} particles still active", p + 1, nPoints, ensemble.getPopulation());
+        }
+        index << "]}}";
+    }
+
+    // optimization: every evaluation propagates the same initial ensemble (common random numbers), so the differences
+    // between candidates are not buried in sampling noise, and a candidate is stopped as soon as its objective bound shows
+    // it cannot beat the one it is compared with, at the optimum a final propagation gives the regular simulation output
+    void Simulation::runOptimization() {
+        MC_PROFILE_FUNCTION();
+        std::vector<std::string> names = optimizer.getNames();
+        MC_CORE_INFO("optimizing {0} parameters", names.size());
+        if (!objective) {
+            objective = [this]() { return -(double)ensemble.getPopulation(); };
+            if (!objectiveBound && sources.empty()) { objectiveBound = objective; }
+        }
+
+        saveInitialState();
         ensemble.save("initials");
+        auto evaluate = [&](const std::vector<double>& x, double threshold, bool& pruned) {
+            setParameters(names, x);
+            restoreInitialState();
+            watcher.resetObservers();
+            m_pruneAbove = threshold;
+            m_pruned = false;
+            propagate();
+            m_pruneAbove = std::numeric_limits<double>::infinity();
+            pruned = m_pruned;
+            return m_pruned ? objectiveBound() : evaluateObjective();
+        };
+        std::vector<double> best = optimizer.minimize(evaluate);
+        optimizer.write("output/optimization.json");
+
+        setParameters(names, best);
+        restoreInitialState();
+        watcher.resetObservers();
         propagate();
         ensemble.save("finals");
+        MC_CORE_INFO("objective at the optimum: {0}", evaluateObjective());
+    }
+
+    double Simulation::evaluateObjective() {
+        return objective ? objective() : -(double)ensemble.getPopulation();
+    }
+
+    double& Simulation::parameter(const std::string& name, double defaultValue) {
+        return parameters.try_emplace(name, defaultValue).first->second;
+    }
+
+    // set the parameters of a point, they are visible to the C++ code (see parameter()) and as Lua globals
+    // a name that is neither a parameter nor a Lua global is probably misspelled, it is reported once (by the first point)
+    void Simulation::setParameters(const std::vector<std::string>& names, const std::vector<double>& values) {
+        for (size_t a = 0; a < names.size(); ++a) {
+            sol::object global = lua[names[a]];
+            if (parameters.find(names[a]) == parameters.end() && global.get_type() == sol::type::lua_nil) {
+                MC_CORE_WARN("parameter '{0}' is not used by the simulation or defined in the script", names[a]);
+            }
+            parameter(names[a]) = values[a];
+            lua[names[a]] = values[a];
+            if (m_luaPool) { m_luaPool->setGlobal(names[a], values[a]); }
+        }
+    }
+
+    void Simulation::saveInitialState() {
+        MC_PROFILE_FUNCTION();
+        BinaryWriter out;
+        ensemble.saveState(out);
+        m_initialState = std::move(out.getBuffer());
+    }
+
+    // reset the ensemble (into its existing storage), the sources and the observer schedules to the start of a run
+    void Simulation::restoreInitialState() {
+        MC_PROFILE_FUNCTION();
+        BinaryReader in(m_initialState);
+        ensemble.loadState(in);     // including the random streams, so sources emit the same particles every time
+        for (auto& source : sources) { source->reset(); }
+        watcher.restart();
+        m_resumed = false;
     }
 
-    void Simulation::propagate() {
+    bool Simulation::propagate() {
         MC_PROFILE_FUNCTION();
         MC_CORE_TRACE("propagating {0} particles...", ensemble.getPopulation());
 
@@ -38,22 +251,253 @@ namespace molecool {
         // (non parallelized) unique copies of the stepper and system function, and use mkl operations
         //using stepper_type = velocity_verlet< state_type >;
         //using stepper_type = velocity_verlet< state_type, state_type, double, state_type, double, double, vector_space_algebra, mkl_operations >;
-        using stepper_type = velocity_verlet< state_type, state_type, double, state_type, double, double, openmp_range_algebra >;
+        //using stepper_type = velocity_verlet< state_type, state_type, double, state_type, double, double, openmp_range_algebra >;
+        // the scheduler algebra runs the element-wise operations through the same execution layer as the forces
+        // (OpenMP static blocks by default, or the native work-stealing scheduler)
+        using stepper_type = velocity_verlet< state_type, state_type, double, state_type, double, double, scheduler_range_algebra >;
         stepper_type stepper;
-        for (double t = tStart; t <= tEnd; t += dt) {
+        state_type& x = ensemble.getPos();
+        state_type& v = ensemble.getVel();
+
+        // the system function seen by the stepper, timing the force evaluations for the telemetry
+        auto system = [this](state_type const& x, state_type const& v, state_type& a, double t) {
+            Telemetry::PhaseTimer timer(telemetry, Telemetry::Phase::forces, Telemetry::Phase::integrate);
+            thruster(x, v, a, t);
+        };
+
+        // the accelerations are passed to the stepper explicitly (the same as its internal handling), so that
+        // the integrator state is owned here and a resumed run continues exactly where the checkpoint was taken
+        if (!m_resumed) {
+            if (!geometry.isEmpty()) { geometry.reset(ensemble); }
+            m_t = tStart;
+            m_currentAcc = 0;
+            for (auto& acc : m_accelerations) {
+                acc.clear();
+                Memory::resizeFirstTouch(acc, x.size(), 0.0, MC_DIMS);
+            }
+            thruster(x, v, m_accelerations[m_currentAcc], m_t);
+            watcher.start(ensemble, m_t, dt);
+        }
+        telemetry.start(m_t, tEnd, dt);
+        if (blockParticles > 0) { return propagateBlocked(); }
+
+        for (; m_t <= tEnd; m_t += dt) {
             // check for early exit
-            if (ensemble.getPopulation() == 0) { break; }
+            if (ensemble.getPopulation() == 0 && !isEmitting(m_t)) { break; }
+
+            // inject the particles emitted by the sources in this step
+            if (!sources.empty()) {
+                Telemetry::PhaseTimer timer(telemetry, Telemetry::Phase::integrate);
+                emitParticles(m_t);
+            }
 
             // calculate the relevant quantum state populations (if appropriate)
 
             // advance classical states one timestep
-            stepper.do_step(std::ref(thruster), std::make_pair(std::ref(ensemble.getPos()), std::ref(ensemble.getVel())), t, dt);
+            state_type& accIn = m_accelerations[m_currentAcc];
+            state_type& accOut = m_accelerations[1 - m_currentAcc];
+            {
+                Telemetry::PhaseTimer timer(telemetry, Telemetry::Phase::integrate);
+                stepper.do_step(system, x, v, accIn, x, v, accOut, m_t, dt);
+            }
+            m_currentAcc = 1 - m_currentAcc;
             
             // deploy watcher object, tracking trajectories, population statistics, etc.
-            watcher.deployObservers(ensemble, t);
+            {
+                Telemetry::PhaseTimer timer(telemetry, Telemetry::Phase::observe);
+                watcher.deployObservers(ensemble, m_t);
+            }
 
+            // checkpoint the state at the end of this step, i.e. the start of the next one
+            if (checkpointer.isDue(m_t)) {
+                Telemetry::PhaseTimer timer(telemetry, Telemetry::Phase::io);
+                saveCheckpoint(m_t + dt);
+                if (checkpointer.isStopRequested()) {
+                    checkpointer.wait();
+                    telemetry.stop();
+                    MC_CORE_WARN("propagation stopped at t = {0}, resume from checkpoint", m_t + dt);
+                    return false;
+                }
+            }
+
+            telemetry.endStep(m_t + dt, ensemble.getPopulation());
+
+            // optimization candidates that cannot win any more
+            if (isLosing()) {
+                m_pruned = true;
+                break;
+            }
         }
+        telemetry.stop();
         MC_CORE_TRACE("propagation complete, {0} particles still active", ensemble.getPopulation());
+        return true;
+    }
+
+    // temporally tiled propagation: the same velocity-verlet steps (in the same order of operations as the odeint stepper,
+    // so the trajectories are identical), but each block of particles is taken through all steps of a tile before the
+    // next block is loaded, instead of streaming the whole ensemble through memory several times per step
+    // a tile ends where an observer may be due (see Watcher::getStepsToSync), so observers still see the complete ensemble
+    // at their sample times, observers deployed every step (or on population/trigger conditions) leave tiles of one step
+    bool Simulation::propagateBlocked() {
+        MC_PROFILE_FUNCTION();
+        state_type& x = ensemble.getPos();
+        state_type& v = ensemble.getVel();
+        const long long nParticles = (long long)x.size() / MC_DIMS;
+        const int maxSteps = std::max(1, blockSteps);
+        std::vector<double> times;                  // the start times of the steps in a tile
+        times.reserve(maxSteps);
+        bool untiled = true;
+
+        while (m_t <= tEnd) {
+            // check for early exit
+            if (ensemble.getPopulation() == 0 && !isEmitting(m_t)) { break; }
+
+            // the steps of this tile, times accumulated like the step loop does
+            // particles are only injected at the start of a tile, a tile ends before the next step with emissions
+            int nSteps = watcher.getStepsToSync(m_t, dt, maxSteps);
+            if (!sources.empty()) {
+                if (getQuietSteps(m_t, nSteps) == 0) {
+                    Telemetry::PhaseTimer timer(telemetry, Telemetry::Phase::integrate);
+                    emitParticles(m_t);
+                    nSteps = 1 + getQuietSteps(m_t + dt, nSteps - 1);
+                }
+                else {
+                    nSteps = getQuietSteps(m_t, nSteps);
+                }
+            }
+            times.clear();
+            for (double t = m_t; (int)times.size() < nSteps && t <= tEnd; t += dt) { times.push_back(t); }
+            nSteps = (int)times.size();
+            if (untiled && nSteps > 1) { untiled = false; }
+
+            // advance every block through the tile, the force evaluations are part of the integrate phase here
+            {
+                Telemetry::PhaseTimer timer(telemetry, Telemetry::Phase::integrate);
+                const int cur = m_currentAcc;
+                Scheduler::get().parallelFor(nParticles, [&](long long begin, long long end, int worker) {
+                    for (long long b = begin; b < end; b += blockParticles) {
+                        int e = (int)std::min(end, b + blockParticles);
+                        for (int j = 0; j < nSteps; ++j) {
+                            advanceBlock(x, v, m_accelerations[cur ^ (j & 1)], m_accelerations[cur ^ (j & 1) ^ 1], times[j], (int)b, e);
+                        }
+                    }
+                });
+                m_currentAcc ^= (nSteps & 1);
+            }
+            double tLast = times.back();
+            m_t = tLast + dt;
+            thruster.reportLosses(m_t);
+
+            // no observer was due before the last step of the tile
+            {
+                Telemetry::PhaseTimer timer(telemetry, Telemetry::Phase::observe);
+                watcher.skipSteps(nSteps - 1);
+                watcher.deployObservers(ensemble, tLast);
+            }
+
+            // checkpoints are taken at tile ends
+            if (checkpointer.isDue(tLast)) {
+                Telemetry::PhaseTimer timer(telemetry, Telemetry::Phase::io);
+                saveCheckpoint(m_t);
+                if (checkpointer.isStopRequested()) {
+                    checkpointer.wait();
+                    telemetry.stop();
+                    MC_CORE_WARN("propagation stopped at t = {0}, resume from checkpoint", m_t);
+                    return false;
+                }
+            }
+
+            for (int j = 1; j <= nSteps; ++j) { telemetry.endStep(times[j - 1] + dt, ensemble.getPopulation()); }
+
+            // optimization candidates that cannot win any more
+            if (isLosing()) {
+                m_pruned = true;
+                break;
+            }
+        }
+        telemetry.stop();
+        if (untiled) { MC_CORE_TRACE("observers or sources synchronized every step, propagation was not tiled"); }
+        MC_CORE_TRACE("propagation complete, {0} particles still active", ensemble.getPopulation());
+        return true;
+    }
+
+    // one velocity-verlet step of the particles [begin, end), serially
+    void Simulation::advanceBlock(state_type& x, state_type& v, const state_type& accIn, state_type& accOut, double t, int begin, int end) {
+        const double dtx = 0.5 * dt * dt;
+        const double dtv = 0.5 * dt;
+        for (int i = MC_DIMS * begin; i < MC_DIMS * end; ++i) { x[i] = 1.0 * x[i] + dt * v[i] + dtx * accIn[i]; }
+        thruster.evaluate(x, v, accOut, t + dt, begin, end);
+        for (int i = MC_DIMS * begin; i < MC_DIMS * end; ++i) { v[i] = 1.0 * v[i] + dtv * accIn[i] + dtv * accOut[i]; }
+    }
+
+    // inject the particles the sources emit in the step starting at t, and give them their accelerations at t
+    // (the integrator state), the slots of lost particles in the current accelerations hold zeros
+    void Simulation::emitParticles(double t) {
+        m_injected.clear();
+        for (auto& source : sources) {
+            source->emit(ensemble, t, dt, m_injected);
+        }
+        state_type& acc = m_accelerations[m_currentAcc];
+        for (int i : m_injected) {
+            thruster.evaluate(ensemble.getPos(), ensemble.getVel(), acc, t, i, i + 1);
+        }
+    }
+
+    bool Simulation::isEmitting(double t) const {
+        for (const auto& source : sources) {
+            if (!source->isFinished(t)) { return true; }
+        }
+        return false;
+    }
+
+    int Simulation::getQuietSteps(double t, int maxSteps) const {
+        int quiet = maxSteps;
+        for (const auto& source : sources) {
+            quiet = std::min(quiet, source->getQuietSteps(t, dt, quiet));
+        }
+        return quiet;
+    }
+
+    // serialize the complete simulation state at time t in memory, the checkpointer writes it to disk in the background
+    void Simulation::saveCheckpoint(double t) {
+        MC_PROFILE_FUNCTION();
+        BinaryWriter out;
+        out.write(t);
+        out.write(dt);
+        ensemble.saveState(out);
+        out.write(m_currentAcc);
+        out.write(m_accelerations[0]);
+        out.write(m_accelerations[1]);
+        watcher.saveState(out);
+        geometry.saveState(out);
+        for (const auto& source : sources) { source->saveState(out); }
+        checkpointer.write(std::move(out.getBuffer()));
+    }
+
+    bool Simulation::restoreCheckpoint() {
+        MC_PROFILE_FUNCTION();
+        std::vector<char> buffer;
+        if (!checkpointer.read(buffer)) { return false; }
+        BinaryReader in(buffer);
+        double savedDt = 0.0;
+        in.read(m_t);
+        in.read(savedDt);
+        if (savedDt != dt) {
+            MC_CORE_WARN("checkpoint timestep {0} differs from script timestep {1}", savedDt, dt);
+        }
+        ensemble.loadState(in);
+        in.read(m_currentAcc);
+        in.read(m_accelerations[0]);
+        in.read(m_accelerations[1]);
+        bool restored = watcher.loadState(in);
+        geometry.loadState(in);
+        for (auto& source : sources) { source->loadState(in); }
+        if (!restored || !in) {
+            MC_CORE_FATAL("checkpoint could not be restored, exiting...");
+            exit(-1);
+        }
+        MC_CORE_INFO("resuming from checkpoint at t = {0} with {1} particles", m_t, ensemble.getPopulation());
+        return true;
     }
 
     void Simulation::addParticles(int n, ParticleId p, PosDist xDis, VelDist vxDis, PosDist yDis, VelDist vyDis, PosDist zDis, VelDist vzDis) {
@@ -73,17 +517,30 @@ namespace molecool {
         thruster.addForce(ff);
     }
 
-    void Simulation::addObserver(ObserverPtr obs) {
-        watcher.addObserver(obs);
+    void Simulation::addStagedForce(PrepareFunction prepare, StagedForceFunction force) {
+        thruster.addStagedForce(prepare, force);
+    }
+
+    void Simulation::addObserver(ObserverPtr obs, const Schedule& schedule) {
+        watcher.addObserver(obs, schedule);
+    }
+
+    void Simulation::addSource(SourcePtr source) {
+        ensemble.reserveSlots(source->getCapacity());
+        sources.push_back(source);
     }
 
     void Simulation::setupScript() {
         MC_CORE_TRACE("Setting up scripting");
-        lua.open_libraries(sol::lib::base);
+        lua.open_libraries(sol::lib::base, sol::lib::math);
 
         // register usertypes with the lua state so it knows how to create, pass, and/or destroy C++ objects
-        registerObserver<Trajectorizer>("Trajectories", Trajectorizer::make);
+        LuaPool::registerTypes(lua);
+        registerObserver<Trajectorizer>("Trajectories", Trajectorizer::make, Trajectorizer::makeCompressed);
         registerObserver<Staticizer>("Statistics", Staticizer::make);
+        registerObserver<Momentizer>("Moments", Momentizer::make, Momentizer::makeWithMass);
+        registerObserver<Histogrammer>("Histogram", Histogrammer::make1, Histogrammer::make2, Histogrammer::make3);
+        registerObserver<Detectorizer>("Detectors", Detectorizer::make, Detectorizer::makeWithAperture);
 
     }
 
@@ -93,34 +550,328 @@ namespace molecool {
         try {
 
             // read and execute the script (from file)
-            auto result = lua.script_file("src/simulation.lua", sol::script_default_on_error);
+            auto result = lua.script_file(m_scriptFile, sol::script_default_on_error);
 
             // get simulation timing settings
             tStart = lua.get<float>("startTime");   // explicit get of a variable
             tEnd = lua["endTime"];                  // implicit conversion to end type
             dt = lua["timestep"];
 
+            // (optional) execution layer and memory settings, read before the ensemble is created, so its states are
+            // first touched by the threads that will propagate them (see NumaAllocator)
+            // execution layer for the parallel loops, e.g. scheduler = { policy = "native", threads = 8, chunk = 1024, pin = true }
+            // policies are "openmp" (default, static blocks) and "native" (persistent workers with work stealing over chunks of particles)
+            sol::optional<sol::table> sched = lua["scheduler"];
+            if (sched) {
+                sol::table scTbl = sched.value();
+                Scheduler::get().configure(Scheduler::nameToPolicy(scTbl.get_or<std::string>("policy", "openmp")), scTbl.get_or<int>("threads", 0),
+                    scTbl.get_or<int>("chunk", Scheduler::s_defaultChunkSize), scTbl.get_or<bool>("pin", false));
+            }
+            // memory = { hugePages = true } backs large state vectors with transparent huge pages
+            sol::optional<sol::table> mem = lua["memory"];
+            if (mem) {
+                Memory::setHugePages(mem.value().get_or<bool>("hugePages", false));
+            }
+
+            // (optional) out-of-core batches, e.g. batches = { size = 1000000, saveStates = false }
+            sol::optional<sol::table> batches = lua["batches"];
+            if (batches) {
+                sol::table btTbl = batches.value();
+                batchSize = btTbl.get_or<int>("size", batchSize);
+                saveBatchStates = btTbl.get_or<bool>("saveStates", saveBatchStates);
+            }
+
+            // (optional) checkpointing, e.g. checkpoint = { interval = 0.1, file = "output/checkpoint.bin", resume = true }
+            // parsed before the ensemble, which is not sampled when it is restored from a checkpoint
+            sol::optional<sol::table> checkpoint = lua["checkpoint"];
+            sol::object swept = lua["sweep"];
+            sol::object optimized = lua["optimize"];
+            if (checkpoint && (batchSize > 0 || swept.valid() || optimized.valid())) {
+                MC_CORE_WARN("checkpointing is not supported for batched runs, sweeps or optimizations, ignoring checkpoint settings");
+            }
+            else if (checkpoint) {
+                sol::table ckTbl = checkpoint.value();
+                checkpointer.configure(ckTbl.get_or<std::string>("file", "output/checkpoint.bin"), ckTbl.get_or<double>("interval", 0.0), ckTbl.get_or<bool>("resume", false));
+            }
+
+            // (optional) convergence-driven particle count for batched runs, the population becomes the particle budget, e.g.
+            // convergence = { observables = { "survival", "Tz" }, mass = 1.44e-25, relativeError = 0.01, confidence = 0.95, minBatches = 5, maxSeconds = 3600 }
+            // (the species mass in kg is needed for temperatures only)
+            sol::optional<sol::table> conv = lua["convergence"];
+            if (conv && batchSize <= 0) {
+                MC_CORE_WARN("convergence requires batches (batches = { size = ... }), ignoring convergence");
+            }
+            else if (conv) {
+                sol::table cvTbl = conv.value();
+                sol::optional<std::vector<std::string>> names = cvTbl["observables"];
+                if (names) {
+                    double mass = cvTbl.get_or<double>("mass", 0.0);
+                    for (const auto& name : names.value()) { convergence.addObservable(name, Convergence::nameToObservable(name, mass)); }
+                }
+                convergence.configure(cvTbl.get_or<double>("relativeError", 0.01), cvTbl.get_or<double>("confidence", 0.95),
+                    cvTbl.get_or<int>("minBatches", 5), cvTbl.get_or<double>("maxSeconds", 0.0));
+            }
+
             // get ensemble parameters stored in lua "ensemble" table
+            // in out-of-core runs the population may exceed the range of int, and the particles are added batch by batch
+            // an (optional) seed makes the ensemble reproducible between runs
             sol::table ensTbl = lua["ensemble"];
-            int n = ensTbl["population"];
-            Dist xDist = extractDist(ensTbl["xDistribution"]);
-            Dist vxDist = extractDist(ensTbl["vxDistribution"]);
-            Dist yDist = extractDist(ensTbl["yDistribution"]);
-            Dist vyDist = extractDist(ensTbl["vyDistribution"]);
-            Dist zDist = extractDist(ensTbl["zDistribution"]);
-            Dist vzDist = extractDist(ensTbl["vzDistribution"]);
-            addParticles(n, ParticleId::CaF, xDist, vxDist, yDist, vyDist, zDist, vzDist);
+            sol::optional<int> seed = ensTbl["seed"];
+            if (seed) { ensemble.setSeed(seed.value()); }
+            double population = ensTbl["population"];
+            m_totalPopulation = (long long)population;
+            m_initialDists[0] = extractDist(ensTbl["xDistribution"]);
+            m_initialDists[1] = extractDist(ensTbl["vxDistribution"]);
+            m_initialDists[2] = extractDist(ensTbl["yDistribution"]);
+            m_initialDists[3] = extractDist(ensTbl["vyDistribution"]);
+            m_initialDists[4] = extractDist(ensTbl["zDistribution"]);
+            m_initialDists[5] = extractDist(ensTbl["vzDistribution"]);
+            if (batchSize <= 0 && !(checkpointer.isResumeRequested() && checkpointer.exists())) {
+                addParticles((int)m_totalPopulation, ParticleId::CaF, m_initialDists[0], m_initialDists[1], m_initialDists[2], m_initialDists[3], m_initialDists[4], m_initialDists[5]);
+            }
+
+            // (optional) 'sources' array of particle sources emitting during propagation, e.g.
+            // { rate = 1e6, capacity = 20000, from = 0.0, to = 0.5, period = 0.01, duration = 0.001, xDistribution = {...}, vxDistribution = ... }
+            // (continuous emission without period), the capacity is the number of slots reserved for the source's particles
+            sol::optional<sol::table> srcs = lua["sources"];
+            if (srcs && batchSize > 0) {
+                MC_CORE_WARN("sources are not supported for out-of-core (batched) runs, ignoring sources");
+            }
+            else if (srcs) {
+                for (int i = 1; i <= srcs.value().size(); ++i) {
+                    sol::table srcTbl = srcs.value()[i];
+                    Source::Dists dists;
+                    dists[0] = std::make_pair(extractDist(srcTbl["xDistribution"]), extractDist(srcTbl["vxDistribution"]));
+                    dists[1] = std::make_pair(extractDist(srcTbl["yDistribution"]), extractDist(srcTbl["vyDistribution"]));
+                    dists[2] = std::make_pair(extractDist(srcTbl["zDistribution"]), extractDist(srcTbl["vzDistribution"]));
+                    auto source = std::make_shared<Source>(dists, srcTbl.get_or<double>("rate", 0.0), srcTbl.get_or<int>("capacity", 0));
+                    source->setWindow(srcTbl.get_or<double>("from", -std::numeric_limits<double>::infinity()), srcTbl.get_or<double>("to", std::numeric_limits<double>::infinity()));
+                    source->setPulses(srcTbl.get_or<double>("period", 0.0), srcTbl.get_or<double>("duration", 0.0));
+                    addSource(source);
+                }
+            }
 
             // (optional) existence of 'observers' array (table with implicit integer keys 1...) in script:
             // fyi, if the observer object was free (not in a table/array), use this: addObserver(lua.get<ObserverPtr>("key"); or addObserver(lua["key"]);
+            // an element is either an observer, or a table holding an observer along with its deployment schedule, e.g.
+            // { observer = Statistics(), every = 10, interval = 0.01, from = 0.1, to = 0.5, populationBelow = 500 }
             sol::optional<sol::table> observers = lua["observers"];
             if (observers) {
                for (int i = 1; i <= observers.value().size(); ++i) {
-                   addObserver(lua["observers"][i]);
+                   sol::object element = observers.value()[i];
+                   if (element.get_type() == sol::type::table) {
+                       sol::table scheduled = element.as<sol::table>();
+                       Schedule schedule = extractSchedule(scheduled);
+                       if (batchSize > 0 && (schedule.populationBelow >= 0 || schedule.populationAbove >= 0)) {
+                           MC_CORE_WARN("population triggers are not supported for out-of-core (batched) runs, ignoring them");
+                           schedule.populationBelow = schedule.populationAbove = -1;
+                       }
+                       addObserver(scheduled["observer"], schedule);
+                   }
+                   else {
+                       addObserver(element.as<ObserverPtr>());
+                   }
+                }
+            }
+
+            // (optional) temporal tiling of the step loop, e.g. propagation = { blockParticles = 2048, blockSteps = 256 }
+            sol::optional<sol::table> prop = lua["propagation"];
+            if (prop) {
+                sol::table prTbl = prop.value();
+                blockParticles = prTbl.get_or<int>("blockParticles", blockParticles);
+                blockSteps = prTbl.get_or<int>("blockSteps", blockSteps);
+            }
+
+            // (optional) parameter sweep, an array of parameters given by values or by evenly spaced points, e.g.
+            // sweep = { { name = "voltage", from = 0, to = 100, points = 11 }, { name = "delay", values = { 1e-3, 2e-3 } } }
+            sol::optional<sol::table> swp = lua["sweep"];
+            if (swp && batchSize > 0) {
+                MC_CORE_WARN("sweeps are not supported for out-of-core (batched) runs, ignoring sweep");
+            }
+            else if (swp) {
+                for (int i = 1; i <= swp.value().size(); ++i) {
+                    sol::table axTbl = swp.value()[i];
+                    std::string name = axTbl["name"];
+                    sol::optional<std::vector<double>> values = axTbl["values"];
+                    if (values) {
+                        sweep.addAxis(name, values.value());
+                    }
+                    else {
+                        sweep.addAxis(name, axTbl.get_or<double>("from", 0.0), axTbl.get_or<double>("to", 0.0), axTbl.get_or<int>("points", 1));
+                    }
+                }
+            }
+
+            // (optional) optimization of parameters (Nelder-Mead), e.g.
+            // optimize = { parameters = { { name = "delay", initial = 1e-3, step = 2e-4, min = 0, max = 1e-2 } }, evaluations = 200, tolerance = 1,
+            //              objective = function(population, results) return -results[1].pop end }
+            // the objective (to be minimized) is optional, by default the final population is maximized, results holds
+            // the summaries of the observers (in the order of the observers table, see Observer::getSummary)
+            sol::optional<sol::table> opt = lua["optimize"];
+            if (opt && (batchSize > 0 || !sweep.isEmpty())) {
+                MC_CORE_WARN("optimization is not supported for batched runs or sweeps, ignoring optimization");
+            }
+            else if (opt) {
+                sol::table opTbl = opt.value();
+                sol::table params = opTbl["parameters"];
+                for (int i = 1; i <= params.size(); ++i) {
+                    sol::table pTbl = params[i];
+                    Optimizer::Parameter p;
+                    std::string name = pTbl["name"];
+                    p.name = name;
+                    p.initial = pTbl.get_or<double>("initial", 0.0);
+                    p.step = pTbl.get_or<double>("step", 1.0);
+                    p.min = pTbl.get_or<double>("min", -std::numeric_limits<double>::infinity());
+                    p.max = pTbl.get_or<double>("max", std::numeric_limits<double>::infinity());
+                    optimizer.addParameter(p);
                 }
+                optimizer.configure(opTbl.get_or<int>("evaluations", 100), opTbl.get_or<double>("tolerance", 1e-6));
+                sol::optional<sol::protected_function> fn = opTbl["objective"];
+                if (fn) {
+                    sol::protected_function userObjective = fn.value();
+                    objective = [this, userObjective]() {
+                        std::vector<Observer::Summary> summaries = watcher.getSummaries();
+                        sol::table results = lua.create_table();
+                        for (size_t k = 0; k < summaries.size(); ++k) {
+                            sol::table entry = lua.create_table();
+                            for (const auto& [key, value] : summaries[k]) { entry[key] = value; }
+                            results[k + 1] = entry;
+                        }
+                        sol::protected_function_result result = userObjective(ensemble.getPopulation(), results);
+                        if (!result.valid()) {
+                            sol::error err = result;
+                            MC_CORE_ERROR("objective function threw {0}", err.what());
+                            return std::numeric_limits<double>::infinity();
+                        }
+                        return result.get<double>();
+                    };
+                }
+            }
+
+            // (optional) live telemetry, e.g. telemetry = { file = "output/metrics.prom", period = 5 } (period in wall-clock seconds)
+            sol::optional<sol::table> telem = lua["telemetry"];
+            if (telem) {
+                sol::table tlTbl = telem.value();
+                telemetry.configure(tlTbl.get_or<std::string>("file", "output/metrics.prom"), tlTbl.get_or<double>("period", 5.0));
             }
 
-            // (optional) existence of 'forces' or 'potentials' array(s), with elements that are either strings or objects 
+            // (optional) named switching schedules (e.g. of decelerator stages or laser pulses): values from the given
+            // times on, held (or linearly interpolated), optionally repeated with a period, used by name in expressions
+            // and by staged forces (see Thruster), e.g.
+            // schedules = { stage = { times = { 0, 1e-4, 2e-4 }, values = { 1, 0, 1 }, period = 3e-4 } }
+            sol::optional<sol::table> scheds = lua["schedules"];
+            if (scheds) {
+                scheds.value().for_each([&](sol::object key, sol::object value) {
+                    sol::table scTbl = value.as<sol::table>();
+                    sol::optional<std::vector<double>> times = scTbl["times"];
+                    sol::optional<std::vector<double>> values = scTbl["values"];
+                    schedules[key.as<std::string>()] = SwitchingSchedule(times.value_or(std::vector<double>()),
+                        values.value_or(std::vector<double>()), scTbl.get_or<bool>("linear", false), scTbl.get_or<double>("period", 0.0));
+                });
+            }
+
+            // (optional) 'forces' and 'filters' arrays, an element is either an expression of the particle state, compiled
+            // once and evaluated for chunks of particles without calling Lua (see Expression), or a Lua function called
+            // for batches of particles on per-thread Lua states (see LuaPool), a missing force component is zero, a
+            // particle is stopped where a filter is nonzero, e.g.
+            // k = 2.0
+            // forces = { { x = "-k*x", y = "-k*y", z = "-k*z" }, { y = "-9.8" }, function(batch, t) ... end }
+            // filters = { "r > 0.01", "abs(z) > 0.005 && t > 1e-3", function(batch, t) ... end }
+            sol::optional<sol::table> frcs = lua["forces"];
+            if (frcs) {
+                for (int i = 1; i <= frcs.value().size(); ++i) {
+                    thruster.addChunkForce(extractForce(frcs.value()[i], "forces[" + std::to_string(i) + "]"));
+                }
+            }
+            sol::optional<sol::table> fltrs = lua["filters"];
+            if (fltrs) {
+                for (int i = 1; i <= fltrs.value().size(); ++i) {
+                    thruster.addChunkFilter(extractFilter(fltrs.value()[i], "filters[" + std::to_string(i) + "]"));
+                }
+            }
+
+            // (optional) beamline of elements with forces and aperture filters (as above) acting within [from, to] along
+            // the beam axis only, a chunk of particles is only evaluated for the elements it overlaps, e.g.
+            // beamline = { axis = "z", cell = 0.01, elements = {
+            //     { name = "skimmer", from = 0.100, to = 0.101, filters = { "x^2 + y^2 > 1e-6" } },
+            //     { name = "hexapole", from = 0.2, to = 0.35, forces = { { x = "-k*x", y = "-k*y" } } } } }
+            sol::optional<sol::table> bl = lua["beamline"];
+            if (bl) {
+                sol::table blTbl = bl.value();
+                beamline.configure(Beamline::nameToAxis(blTbl.get_or<std::string>("axis", "z")), blTbl.get_or<double>("cell", 0.0));
+                sol::table elements = blTbl["elements"];
+                for (int i = 1; i <= elements.size(); ++i) {
+                    sol::table elTbl = elements[i];
+                    std::string path = "beamline.elements[" + std::to_string(i) + "]";
+                    Beamline::Element element;
+                    element.name = elTbl.get_or<std::string>("name", "element " + std::to_string(i));
+                    element.from = elTbl.get_or<double>("from", 0.0);
+                    element.to = elTbl.get_or<double>("to", 0.0);
+                    sol::optional<sol::table> elForces = elTbl["forces"];
+                    for (int j = 1; elForces && j <= elForces.value().size(); ++j) {
+                        element.forces.push_back(extractForce(elForces.value()[j], path + ".forces[" + std::to_string(j) + "]"));
+                    }
+                    sol::optional<sol::table> elFilters = elTbl["filters"];
+                    for (int j = 1; elFilters && j <= elFilters.value().size(); ++j) {
+                        element.filters.push_back(extractFilter(elFilters.value()[j], path + ".filters[" + std::to_string(j) + "]"));
+                    }
+                    beamline.addElement(element);
+                }
+            }
+            // (optional) geometry: thin apertures (circle, rectangle, annulus, plane) at a position along the beam axis and
+            // tubes from/to, tested against the straight segment of every step, so thin plates are not jumped over, e.g.
+            // geometry = { axis = "z", apertures = {
+            //     { shape = "circle", at = 0.1, radius = 1e-3, center = { 0.0, 0.0 } },
+            //     { shape = "rectangle", at = 0.2, width = 2e-3, height = 4e-3 },
+            //     { shape = "annulus", at = 0.3, inner = 5e-4, outer = 2e-3 },
+            //     { shape = "tube", from = 0.4, to = 0.6, radius = 3e-3 }, { shape = "plane", at = 1.0 } } }
+            sol::optional<sol::table> geo = lua["geometry"];
+            if (geo) {
+                sol::table geoTbl = geo.value();
+                geometry.configure(Beamline::nameToAxis(geoTbl.get_or<std::string>("axis", "z")));
+                sol::table apertures = geoTbl["apertures"];
+                for (int i = 1; i <= apertures.size(); ++i) {
+                    sol::table apTbl = apertures[i];
+                    Aperture ap;
+                    ap.shape = Geometry::nameToShape(apTbl.get_or<std::string>("shape", "circle"));
+                    ap.position = apTbl.get_or<double>(ap.shape == ApertureShape::tube ? "from" : "at", 0.0);
+                    ap.end = apTbl.get_or<double>("to", ap.position);
+                    sol::optional<std::vector<double>> center = apTbl["center"];
+                    if (center && center.value().size() >= 2) {
+                        ap.u = center.value()[0];
+                        ap.v = center.value()[1];
+                    }
+                    switch (ap.shape) {
+                    case ApertureShape::rectangle:
+                        ap.a = apTbl.get_or<double>("width", 0.0);
+                        ap.b = apTbl.get_or<double>("height", 0.0);
+                        break;
+                    case ApertureShape::annulus:
+                        ap.a = apTbl.get_or<double>("inner", 0.0);
+                        ap.b = apTbl.get_or<double>("outer", 0.0);
+                        break;
+                    default:
+                        ap.a = apTbl.get_or<double>("radius", 0.0);
+                        break;
+                    }
+                    geometry.addAperture(ap);
+                }
+            }
+            if (!geometry.isEmpty()) {
+                thruster.addChunkFilter([this](const Ensemble& ens, const int* particles, int n, double t, double* stop) {
+                    geometry.evaluate(ens, particles, n, t, stop);
+                });
+            }
+
+            if (!beamline.isEmpty()) {
+                beamline.build();
+                thruster.addChunkForce([this](const Ensemble& ens, const int* particles, int n, double t, double* fx, double* fy, double* fz) {
+                    beamline.evaluateForces(ens, particles, n, t, fx, fy, fz);
+                });
+                thruster.addChunkFilter([this](const Ensemble& ens, const int* particles, int n, double t, double* stop) {
+                    beamline.evaluateFilters(ens, particles, n, t, stop);
+                });
+            }
 
         }
         catch (sol::error& err) {
@@ -130,6 +881,75 @@ namespace molecool {
 
     }
 
+    // the worker states run the script for its functions only, the registered types are replaced by no-ops there, so
+    // e.g. the observers of the script are not constructed once per thread
+    LuaPoolPtr Simulation::getLuaPool() {
+        if (!m_luaPool) {
+            std::vector<std::string> types = m_scriptTypes;
+            m_luaPool = std::make_shared<LuaPool>(m_scriptFile, [types](sol::state& state) {
+                for (const auto& name : types) { state.script(name + " = function() end"); }
+            });
+            for (const auto& p : parameters) { m_luaPool->setGlobal(p.first, p.second); }
+        }
+        return m_luaPool;
+    }
+
+    ExpressionPtr Simulation::compileExpression(const std::string& source) {
+        std::vector<std::string> swept = sweep.getNames();
+        std::vector<std::string> optimized = optimizer.getNames();
+        swept.insert(swept.end(), optimized.begin(), optimized.end());
+        auto resolve = [&](const std::string& name) -> const double* {
+            sol::object global = lua[name];
+            if (global.get_type() == sol::type::number) { return &parameter(name, global.as<double>()); }
+            if (std::find(swept.begin(), swept.end(), name) != swept.end()) { return &parameter(name); }
+            return nullptr;
+        };
+        auto resolveSchedule = [&](const std::string& name) -> const SwitchingSchedule* {
+            auto it = schedules.find(name);
+            return it != schedules.end() ? &it->second : nullptr;
+        };
+        ExpressionPtr expr = std::make_shared<Expression>(source, resolve, resolveSchedule);
+        if (!expr->isValid()) {
+            MC_CORE_FATAL("invalid expression in script, exiting...");
+            exit(-1);
+        }
+        return expr;
+    }
+
+    ChunkForceFunction Simulation::extractForce(sol::object element, const std::string& path) {
+        if (element.get_type() == sol::type::function) {
+            LuaPoolPtr pool = getLuaPool();
+            return [pool, path](const Ensemble& ens, const int* particles, int n, double t, double* fx, double* fy, double* fz) {
+                pool->call(path, ens, particles, n, t, fx, fy, fz, nullptr);
+            };
+        }
+        sol::table fTbl = element.as<sol::table>();
+        std::array<ExpressionPtr, MC_DIMS> components;
+        const char* names[MC_DIMS] = { "x", "y", "z" };
+        for (int d = 0; d < MC_DIMS; ++d) {
+            sol::optional<std::string> source = fTbl[names[d]];
+            components[d] = compileExpression(source.value_or("0"));
+        }
+        return [components](const Ensemble& ens, const int* particles, int n, double t, double* fx, double* fy, double* fz) {
+            components[0]->evaluate(ens, particles, n, t, fx);
+            components[1]->evaluate(ens, particles, n, t, fy);
+            components[2]->evaluate(ens, particles, n, t, fz);
+        };
+    }
+
+    ChunkFilterFunction Simulation::extractFilter(sol::object element, const std::string& path) {
+        if (element.get_type() == sol::type::function) {
+            LuaPoolPtr pool = getLuaPool();
+            return [pool, path](const Ensemble& ens, const int* particles, int n, double t, double* stop) {
+                pool->call(path, ens, particles, n, t, nullptr, nullptr, nullptr, stop);
+            };
+        }
+        ExpressionPtr expr = compileExpression(element.as<std::string>());
+        return [expr](const Ensemble& ens, const int* particles, int n, double t, double* stop) {
+            expr->evaluate(ens, particles, n, t, stop);
+        };
+    }
+
     Dist Simulation::extractDist(sol::table table) {
         PDF pdf = nameToPDF(table["pdf"]);
         double p1 = 0.0, p2 = 0.0;  // shape parameters
@@ -153,6 +973,17 @@ namespace molecool {
         return Dist(pdf, p1, p2);
     }
 
+    Schedule Simulation::extractSchedule(sol::table table) {
+        Schedule schedule;
+        schedule.everySteps = table.get_or<int>("every", schedule.everySteps);
+        schedule.interval = table.get_or<double>("interval", schedule.interval);
+        schedule.from = table.get_or<double>("from", schedule.from);
+        schedule.to = table.get_or<double>("to", schedule.to);
+        schedule.populationBelow = table.get_or<int>("populationBelow", schedule.populationBelow);
+        schedule.populationAbove = table.get_or<int>("populationAbove", schedule.populationAbove);
+        return schedule;
+    }
+
     // could this be cleaner using magic enum?
     // this should probably be a static method of the PDF class
     // better yet, make the PDF constructor be able to take in a name/string?
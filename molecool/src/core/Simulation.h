@@ -1,9 +1,21 @@
 #pragma once
 
+#include <map>
 #include "Core.h"
 #include "Ensemble.h"
 #include "Thruster.h"
 #include "Watcher.h"
+#include "Checkpointer.h"
+#include "Telemetry.h"
+#include "Source.h"
+#include "Sweep.h"
+#include "Optimizer.h"
+#include "Convergence.h"
+#include "Expression.h"
+#include "LuaPool.h"
+#include "Beamline.h"
+#include "Geometry.h"
+#include "SwitchingSchedule.h"
 #include "sol/sol.hpp"
 
 extern "C" {
@@ -24,33 +36,119 @@ namespace molecool {
         void addParticles(int n, ParticleId p, PosDist xDis = Dist(), VelDist vxDis = Dist(), PosDist yDis = Dist(), VelDist vyDis = Dist(), PosDist zDis = Dist(), VelDist vzDis = Dist());
         void addFilter(FilterFunction ff);
         void addForce(ForceFunction ff);
-        void addObserver(ObserverPtr obs);
+        void addStagedForce(PrepareFunction prepare, StagedForceFunction force);    // see Thruster
+        void addObserver(ObserverPtr obs, const Schedule& schedule = Schedule());
+        void addSource(SourcePtr source);          // reserves the source's capacity in the ensemble, call before run()
 
         // a template for registering derived classes of Observer with Lua, to be called from/during user simulation constructor
         // here the usertype is created using a sol::factory, i.e. a generating function that returns a smart pointer
         // in this case, Lua shouldn't actually do the allocation, C++ allocates the memory and has full ownership
-        template <class C, typename ...Args>
-        void registerObserver(std::string name, ObserverPtr(*facFunc)(Args... args)) {
-            lua.new_usertype<C>(name, sol::call_constructor, sol::factories(facFunc));
+        // several factories (overloads, distinguished by their arguments) can be given for the same Lua name
+        template <class C, typename ...Factories>
+        void registerObserver(std::string name, Factories... facFuncs) {
+            lua.new_usertype<C>(name, sol::call_constructor, sol::factories(facFuncs...));
+            m_scriptTypes.push_back(name);
         }
 
+        // a named parameter (e.g. of a force) that sweeps vary, references remain valid, so force functions can capture
+        // them once, e.g. const double& voltage = parameter("voltage", 100.0);
+        double& parameter(const std::string& name, double defaultValue = 0.0);
+
+        // the value minimized by optimizations, evaluated at the end of every propagation (by default minus the final
+        // population, i.e. as many particles as possible are kept), objectiveBound is a lower bound of the final value
+        // during propagation (by default minus the current population, if there are no sources), it allows a candidate
+        // that can no longer beat the one it is compared with to be stopped early, the objective functions can use e.g.
+        // observers kept by the client (see Observer::getSummary)
+        std::function<double()> objective;
+        std::function<double()> objectiveBound;
+
         // simulation time control
         double tStart = 0.0;
         double tEnd = 1.0;
         double dt = 0.001;
 
+        // temporal tiling: blocks of blockParticles particles are advanced for up to blockSteps steps at a time while
+        // their state is in cache, observers and checkpoints synchronize at the tile ends (0 propagates step by step)
+        int blockParticles = 0;
+        int blockSteps = 256;
+
+        // out-of-core runs: the ensemble is sampled and propagated in batches of batchSize particles, whose memory is
+        // recycled, so peak memory does not depend on the total population (0 propagates the whole ensemble at once)
+        int batchSize = 0;
+        bool saveBatchStates = true;                // stream the initial and final states of every batch to the output files
+
         sol::state lua;
         Ensemble ensemble;
         Thruster thruster;
         Watcher watcher;
+        Checkpointer checkpointer;
+        Telemetry telemetry;
+        std::vector<SourcePtr> sources;
+        Sweep sweep;
+        Optimizer optimizer;
+        Convergence convergence;                    // batched runs stop once its observables have converged
+        Beamline beamline;                          // localized forces and apertures, indexed along the beam axis
+        Geometry geometry;                          // apertures and tubes, tested against the segments of the steps
+        std::map<std::string, double> parameters;
+        std::map<std::string, SwitchingSchedule> schedules;     // by name, from the script, references remain valid
+
+    protected:
+        bool propagate();                           // returns false if propagation was stopped before tEnd
 
     private:
 
-        void propagate();
+        // integrator (velocity-verlet) state, kept here rather than inside the odeint stepper so it can be checkpointed
+        std::array<state_type, 2> m_accelerations;  // accelerations at the current time, and scratch for the next step
+        int m_currentAcc = 0;                       // index of the current accelerations
+        double m_t = 0.0;                           // current simulation time
+        bool m_resumed = false;                     // true if the state was restored from a checkpoint
+
+        // the initial ensemble, sampled batch by batch in out-of-core runs
+        long long m_totalPopulation = 0;
+        std::array<Dist, 2 * MC_DIMS> m_initialDists;   // x, vx, y, vy, z, vz
+
+        std::vector<char> m_initialState;           // the initial ensemble of sweeps, serialized once, restored for every point
+        std::vector<int> m_injected;                // slots of the particles injected by the sources in a step, reused
+        double m_pruneAbove = std::numeric_limits<double>::infinity();  // stop propagating once objectiveBound() reaches this
+        bool m_pruned = false;                      // the last propagation was stopped early by the objective bound
+
+        void runBatches();
+        void runSweep();
+        void runOptimization();
+        double evaluateObjective();
+        inline bool isLosing() { return m_pruneAbove < std::numeric_limits<double>::infinity() && objectiveBound && objectiveBound() >= m_pruneAbove; }
+        void setParameters(const std::vector<std::string>& names, const std::vector<double>& values);
+        void saveInitialState();
+        void restoreInitialState();
+        bool propagateBlocked();
+        void emitParticles(double t);
+        bool isEmitting(double t) const;            // true if a source may still emit particles after time t
+        int getQuietSteps(double t, int maxSteps) const;
+        void advanceBlock(state_type& x, state_type& v, const state_type& accIn, state_type& accOut, double t, int begin, int end);
+
+        // the script, its registered types (only the main state constructs them), and the per-thread states of scripted
+        // forces and filters, created on demand
+        std::string m_scriptFile = "src/simulation.lua";
+        std::vector<std::string> m_scriptTypes;
+        LuaPoolPtr m_luaPool;
+
         void setupScript();
         void parseScript();
+        LuaPoolPtr getLuaPool();
+
+        void saveCheckpoint(double t);
+        bool restoreCheckpoint();
 
         Dist extractDist(sol::table table);
+        Schedule extractSchedule(sol::table table);
+
+        // compile an expression of the script, its names are Lua globals (numbers) or swept/optimized parameters, see parameter()
+        ExpressionPtr compileExpression(const std::string& source);
+
+        // a force or filter of the script, an expression (a table of components for forces) or a Lua function, path is
+        // the Lua expression of the element (e.g. "forces[2]"), by which the per-thread states find the function
+        ChunkForceFunction extractForce(sol::object element, const std::string& path);
+        ChunkFilterFunction extractFilter(sol::object element, const std::string& path);
         PDF nameToPDF(std::string name);
 
     };
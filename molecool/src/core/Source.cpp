@@ -0,0 +1,76 @@
+#include "mcpch.h"
+#include "Source.h"
+
+namespace molecool {
+
+    Source::Source(const Dists& dists, double rate, int capacity)
+        : m_dists(dists), m_rate(rate), m_capacity(capacity)
+    {
+        MC_CORE_TRACE("Creating source, {0} particles per unit time, capacity {1}", m_rate, m_capacity);
+    }
+
+    void Source::setWindow(double from, double to) {
+        m_from = from;
+        m_to = to;
+    }
+
+    void Source::setPulses(double period, double duration) {
+        m_period = period;
+        m_duration = duration;
+    }
+
+    int Source::emit(Ensemble& ens, double t, double dt, std::vector<int>& slots) {
+        double due = m_rate * getEmittingTime(t, t + dt) + m_carry;
+        int n = (int)due;
+        m_carry = due - n;
+        if (n <= 0) { return 0; }
+        int emitted = ens.injectParticles(n, ParticleId::CaF, m_dists, slots);
+        if (emitted < n) {
+            m_dropped += n - emitted;
+            MC_CORE_LIMITED(warn, 5.0, "source capacity exhausted at t = {0}, {1} particles dropped so far", t, m_dropped);
+        }
+        return emitted;
+    }
+
+    // the same accumulation as emit(), without emitting
+    int Source::getQuietSteps(double t, double dt, int maxSteps) const {
+        double carry = m_carry;
+        for (int j = 0; j < maxSteps; ++j, t += dt) {
+            carry += m_rate * getEmittingTime(t, t + dt);
+            if (carry >= 1.0) { return j; }
+        }
+        return maxSteps;
+    }
+
+    double Source::getEmittingTime(double t0, double t1) const {
+        double lo = std::max(t0, m_from);
+        double hi = std::min(t1, m_to);
+        if (hi <= lo) { return 0.0; }
+        if (m_period <= 0.0) { return hi - lo; }
+
+        // overlap with the pulses [start, start + duration) that begin before hi
+        double origin = std::isfinite(m_from) ? m_from : 0.0;
+        double total = 0.0;
+        for (double k = std::floor((lo - origin) / m_period); origin + k * m_period < hi; k += 1.0) {
+            double start = origin + k * m_period;
+            total += std::max(0.0, std::min(hi, start + m_duration) - std::max(lo, start));
+        }
+        return total;
+    }
+
+    void Source::reset() {
+        m_carry = 0.0;
+        m_dropped = 0;
+    }
+
+    void Source::saveState(BinaryWriter& out) const {
+        out.write(m_carry);
+        out.write(m_dropped);
+    }
+
+    void Source::loadState(BinaryReader& in) {
+        in.read(m_carry);
+        in.read(m_dropped);
+    }
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <limits>
+#include "Ensemble.h"
+#include "Serialization.h"
+
+namespace molecool {
+
+    class Source;                                   // forward declaration
+    using SourcePtr = std::shared_ptr<Source>;
+
+    // emits particles into the ensemble during propagation, continuously at a rate (particles per unit of
+    // simulation time) or in pulses (emitting at the rate for a duration, once every period), within a time window
+    // the particles due in a step are rate * (emitting time within the step), the fractional remainder is carried
+    // to the next step, so the emitted count is exact on average and does not depend on the timestep
+    // new particles fill the free slots of the ensemble (see Ensemble::injectParticles), the simulation reserves
+    // the source's capacity in the ensemble up front, if no slot is free the particle is dropped (and counted)
+    class Source
+    {
+    public:
+        using Dists = std::array< std::pair<PosDist, VelDist>, MC_DIMS >;
+
+        Source(const Dists& dists, double rate, int capacity);
+
+        // emission window, and pulses (period <= 0 emits continuously), pulses start at the window start (or t = 0)
+        void setWindow(double from, double to);
+        void setPulses(double period, double duration);
+
+        // emit the particles due in the step [t, t + dt), appending their slots
+        int emit(Ensemble& ens, double t, double dt, std::vector<int>& slots);
+
+        // the number of steps (up to maxSteps) from t during which the source does not emit
+        int getQuietSteps(double t, double dt, int maxSteps) const;
+
+        // true if the source does not emit after time t
+        inline bool isFinished(double t) const { return t >= m_to; }
+
+        inline int getCapacity() const { return m_capacity; }
+        inline long long getDropped() const { return m_dropped; }
+
+        // forget the emission history, e.g. for the next point of a sweep
+        void reset();
+
+        // checkpoint support
+        void saveState(BinaryWriter& out) const;
+        void loadState(BinaryReader& in);
+
+    private:
+        Dists m_dists;
+        double m_rate;
+        int m_capacity;
+        double m_from = -std::numeric_limits<double>::infinity();
+        double m_to = std::numeric_limits<double>::infinity();
+        double m_period = 0.0;
+        double m_duration = 0.0;
+        double m_carry = 0.0;                       // fractional particle count carried to the next step
+        long long m_dropped = 0;                    // particles not emitted for lack of a free slot
+
+        // the time within [t0, t1) during which the source emits
+        double getEmittingTime(double t0, double t1) const;
+    };
+
+}
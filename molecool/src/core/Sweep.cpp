@@ -0,0 +1,45 @@
+#include "mcpch.h"
+#include "Sweep.h"
+
+namespace molecool {
+
+    void Sweep::addAxis(const std::string& name, const std::vector<double>& values) {
+        if (values.empty()) {
+            MC_CORE_WARN("sweep parameter {0} has no values, ignoring it", name);
+            return;
+        }
+        m_axes.push_back({ name, values });
+    }
+
+    void Sweep::addAxis(const std::string& name, double from, double to, int nPoints) {
+        std::vector<double> values;
+        for (int i = 0; i < nPoints; ++i) {
+            values.push_back(nPoints > 1 ? from + (to - from) * i / (nPoints - 1) : from);
+        }
+        addAxis(name, values);
+    }
+
+    std::vector<std::string> Sweep::getNames() const {
+        std::vector<std::string> names;
+        for (const auto& axis : m_axes) { names.push_back(axis.name); }
+        return names;
+    }
+
+    long long Sweep::getNumPoints() const {
+        if (m_axes.empty()) { return 0; }
+        long long n = 1;
+        for (const auto& axis : m_axes) { n *= (long long)axis.values.size(); }
+        return n;
+    }
+
+    std::vector<double> Sweep::getPoint(long long index) const {
+        std::vector<double> point(m_axes.size());
+        for (int a = (int)m_axes.size() - 1; a >= 0; --a) {
+            long long n = (long long)m_axes[a].values.size();
+            point[a] = m_axes[a].values[index % n];
+            index /= n;
+        }
+        return point;
+    }
+
+}
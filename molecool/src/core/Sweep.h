@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace molecool {
+
+    // a swept parameter and its values
+    struct SweepAxis {
+        std::string name;
+        std::vector<double> values;
+    };
+
+    // the points of a parameter sweep, i.e. the cartesian product of the values of its axes (the last axis varies fastest)
+    class Sweep
+    {
+    public:
+        void addAxis(const std::string& name, const std::vector<double>& values);
+        void addAxis(const std::string& name, double from, double to, int nPoints);    // evenly spaced values, from and to included
+
+        inline bool isEmpty() const { return m_axes.empty(); }
+        inline const std::vector<SweepAxis>& getAxes() const { return m_axes; }
+        std::vector<std::string> getNames() const;
+        long long getNumPoints() const;
+
+        // the parameter values of point index (0...getNumPoints() - 1), in the order of the axes
+        std::vector<double> getPoint(long long index) const;
+
+    private:
+        std::vector<SweepAxis> m_axes;
+    };
+
+}
@@ -0,0 +1,63 @@
+#include "mcpch.h"
+#include "SwitchingSchedule.h"
+
+namespace molecool {
+
+    SwitchingSchedule::SwitchingSchedule(const std::vector<double>& times, const std::vector<double>& values, bool linear, double period)
+        : m_linear(linear), m_period(period)
+    {
+        size_t n = std::min(times.size(), values.size());
+        if (times.size() != values.size()) {
+            MC_CORE_WARN("switching schedule has {0} times and {1} values, using the first {2}", times.size(), values.size(), n);
+        }
+        std::vector<std::pair<double, double>> switches;
+        for (size_t k = 0; k < n; ++k) { switches.emplace_back(times[k], values[k]); }
+        if (!std::is_sorted(switches.begin(), switches.end())) {
+            MC_CORE_WARN("switching times are not in order, sorting them");
+            std::stable_sort(switches.begin(), switches.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        }
+        for (const auto& s : switches) {
+            m_times.push_back(s.first);
+            m_values.push_back(s.second);
+        }
+        if (m_times.empty()) { return; }
+
+        double span = m_times.back() - m_times.front();
+        if (m_period > 0.0 && m_period < span) {
+            MC_CORE_ERROR("switching schedule period {0} is shorter than its switching times span ({1}), it is not repeated", m_period, span);
+            m_period = 0.0;
+        }
+
+        // about two buckets per switch
+        int nBuckets = std::max(1, 2 * (int)m_times.size());
+        m_bucket = span > 0.0 ? span / nBuckets : 1.0;
+        m_first.resize(nBuckets);
+        int i = 0;
+        for (int b = 0; b < nBuckets; ++b) {
+            double start = m_times.front() + b * m_bucket;
+            while (i + 1 < (int)m_times.size() && m_times[i + 1] <= start) { ++i; }
+            m_first[b] = i;
+        }
+    }
+
+    double SwitchingSchedule::value(double t) const {
+        if (m_times.empty()) { return 0.0; }
+        double t0 = m_times.front();
+        if (m_period > 0.0) {
+            t = t0 + std::fmod(t - t0, m_period);
+            if (t < t0) { t += m_period; }
+        }
+        if (t < t0) { return m_values.front(); }
+        if (t >= m_times.back()) { return m_values.back(); }
+
+        int b = std::min((int)m_first.size() - 1, (int)((t - t0) / m_bucket));
+        // the last switch at or before t lies between the first switches of this bucket and the next one
+        auto lo = m_times.begin() + m_first[b] + 1;
+        auto hi = b + 1 < (int)m_first.size() ? m_times.begin() + m_first[b + 1] + 1 : m_times.end();
+        int i = (int)(std::upper_bound(lo, hi, t) - m_times.begin()) - 1;
+        if (!m_linear) { return m_values[i]; }
+        double f = (t - m_times[i]) / (m_times[i + 1] - m_times[i]);
+        return m_values[i] + f * (m_values[i + 1] - m_values[i]);
+    }
+
+}
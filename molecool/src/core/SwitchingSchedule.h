@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+
+namespace molecool {
+
+    // a piecewise function of time, e.g. the switching of decelerator stages or the pulses of a laser: values at
+    // switching times, held until the next switching time (or linearly interpolated), clamped to the first and last
+    // values outside the switching times, and optionally repeated with a period (at least the span of the switching times)
+    // the lookup uses a uniform grid of buckets over the switching times, each holding the last switch at its start, the
+    // switches within the bucket are binary searched, so the lookup is O(1) for evenly spread switching times and
+    // O(log k) for k switches clustered within one bucket
+    class SwitchingSchedule
+    {
+    public:
+        SwitchingSchedule() = default;
+        SwitchingSchedule(const std::vector<double>& times, const std::vector<double>& values, bool linear = false, double period = 0.0);
+
+        double value(double t) const;
+
+        inline bool isEmpty() const { return m_times.empty(); }
+
+    private:
+        std::vector<double> m_times;
+        std::vector<double> m_values;
+        bool m_linear = false;
+        double m_period = 0.0;
+        double m_bucket = 1.0;                      // bucket width
+        std::vector<int> m_first;                   // the last switch at or before the start of each bucket
+    };
+
+}
@@ -0,0 +1,163 @@
+#include "mcpch.h"
+#include "TabulatedForce.h"
+#include "Scheduler.h"
+
+#include <random>
+
+namespace molecool {
+
+    TabulatedForce::TabulatedForce(const ForceFunction& force, const std::array<GridAxis, MC_DIMS>& grid, double t)
+        : m_force(force), m_grid(grid)
+    {
+        size_t nNodes = 1;
+        for (int d = MC_DIMS - 1; d >= 0; --d) {
+            GridAxis& ax = m_grid[d];
+            ax.points = std::max(1, ax.points);
+            if (ax.points > 1 && !(ax.to > ax.from)) {
+                MC_CORE_WARN("tabulation grid axis {0} is empty, using a single point", d);
+                ax.points = 1;
+            }
+            m_inverseSpacing[d] = ax.points > 1 ? (ax.points - 1) / (ax.to - ax.from) : 0.0;
+            m_stride[d] = ax.points > 1 ? nNodes : 0;
+            nNodes *= ax.points;
+            if (nNodes > s_maxNodes) {
+                MC_CORE_ERROR("tabulation grid has more than {0} nodes, the force is not tabulated", s_maxNodes);
+                return;
+            }
+        }
+        tabulate(t);
+        measureError(t);
+    }
+
+    Force TabulatedForce::operator() (const ParticleProxy& pp, double t) const {
+        Force f;
+        if (interpolate(&pp.ens.pos[pp.i], f)) { return f; }
+        return m_force(pp, t);
+    }
+
+    void TabulatedForce::tabulate(double t) {
+        MC_PROFILE_FUNCTION();
+        auto start = std::chrono::steady_clock::now();
+        size_t nNodes = 1;
+        for (const auto& ax : m_grid) { nNodes *= ax.points; }
+        std::vector<double> positions(nNodes * MC_DIMS);
+        for (size_t node = 0; node < nNodes; ++node) {
+            size_t rest = node;
+            for (int d = MC_DIMS - 1; d >= 0; --d) {
+                const GridAxis& ax = m_grid[d];
+                size_t k = rest % ax.points;
+                rest /= ax.points;
+                positions[node * MC_DIMS + d] = ax.points > 1 ? ax.from + k / m_inverseSpacing[d] : ax.from;
+            }
+        }
+        auto table = std::make_shared<std::vector<double>>();
+        sample(positions, t, *table);
+        m_maxForce = 0.0;
+        for (size_t node = 0; node < nNodes; ++node) {
+            const double* f = &(*table)[node * MC_DIMS];
+            m_maxForce = std::max(m_maxForce, std::sqrt(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]));
+        }
+        m_table = table;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        MC_CORE_INFO("Tabulated force on {0} x {1} x {2} nodes in {3:.3f} s", m_grid[0].points, m_grid[1].points, m_grid[2].points, seconds);
+    }
+
+    void TabulatedForce::measureError(double t) {
+        if (!m_table) { return; }
+        // a fixed seed, so the reported errors are reproducible
+        std::mt19937_64 engine(12345);
+        std::vector<double> positions(s_errorSamples * MC_DIMS);
+        for (int s = 0; s < s_errorSamples; ++s) {
+            for (int d = 0; d < MC_DIMS; ++d) {
+                const GridAxis& ax = m_grid[d];
+                positions[s * MC_DIMS + d] = ax.points > 1 ? std::uniform_real_distribution<double>(ax.from, ax.to)(engine) : ax.from;
+            }
+        }
+        auto start = std::chrono::steady_clock::now();
+        std::vector<double> exact;
+        sample(positions, t, exact);
+        double exactSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        std::vector<double> interpolated(s_errorSamples * MC_DIMS);
+        Scheduler::get().parallelFor(s_errorSamples, [&](long long begin, long long end, int worker) {
+            for (long long s = begin; s < end; ++s) {
+                Force f;
+                interpolate(&positions[s * MC_DIMS], f);
+                interpolated[s * MC_DIMS] = f.x;
+                interpolated[s * MC_DIMS + 1] = f.y;
+                interpolated[s * MC_DIMS + 2] = f.z;
+            }
+        });
+        double interpolatedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        double sum = 0.0;
+        m_maxError = 0.0;
+        for (int s = 0; s < s_errorSamples; ++s) {
+            double e2 = 0.0;
+            for (int d = 0; d < MC_DIMS; ++d) {
+                double e = interpolated[s * MC_DIMS + d] - exact[s * MC_DIMS + d];
+                e2 += e * e;
+            }
+            sum += e2;
+            m_maxError = std::max(m_maxError, std::sqrt(e2));
+        }
+        m_rmsError = std::sqrt(sum / s_errorSamples);
+        MC_CORE_INFO("Tabulated force error at {0} points: max {1:.3e}, rms {2:.3e} (max force {3:.3e}), interpolation {4:.1f}x faster",
+            s_errorSamples, m_maxError, m_rmsError, m_maxForce, interpolatedSeconds > 0.0 ? exactSeconds / interpolatedSeconds : 0.0);
+    }
+
+    bool TabulatedForce::interpolate(const double* pos, Force& f) const {
+        if (!m_table) { return false; }
+        size_t base = 0;
+        double w[MC_DIMS];
+        for (int d = 0; d < MC_DIMS; ++d) {
+            const GridAxis& ax = m_grid[d];
+            if (ax.points == 1) {
+                w[d] = 0.0;
+                continue;
+            }
+            double u = (pos[d] - ax.from) * m_inverseSpacing[d];
+            if (!(u >= 0.0 && u <= ax.points - 1)) { return false; }
+            int k = std::min((int)u, ax.points - 2);
+            w[d] = u - k;
+            base += k * m_stride[d];
+        }
+        // trilinear, the corners along single point axes coincide (stride 0) with weight 0
+        const double* table = m_table->data();
+        double fx = 0.0, fy = 0.0, fz = 0.0;
+        for (int c = 0; c < (1 << MC_DIMS); ++c) {
+            double weight = 1.0;
+            size_t node = base;
+            for (int d = 0; d < MC_DIMS; ++d) {
+                bool upper = (c >> d) & 1;
+                weight *= upper ? w[d] : 1.0 - w[d];
+                node += upper ? m_stride[d] : 0;
+            }
+            const double* v = table + node * MC_DIMS;
+            fx += weight * v[0];
+            fy += weight * v[1];
+            fz += weight * v[2];
+        }
+        f = Force(fx, fy, fz);
+        return true;
+    }
+
+    // the positions are placed in a small ensemble per worker, so the force sees ordinary particles (at rest)
+    void TabulatedForce::sample(const std::vector<double>& positions, double t, std::vector<double>& forces) const {
+        long long n = (long long)(positions.size() / MC_DIMS);
+        forces.resize(positions.size());
+        Scheduler::get().parallelFor(n, [&](long long begin, long long end, int worker) {
+            Ensemble probe;
+            probe.reserveSlots((int)(end - begin));
+            std::copy(positions.begin() + begin * MC_DIMS, positions.begin() + end * MC_DIMS, probe.pos.begin());
+            for (long long i = begin; i < end; ++i) {
+                Force f = m_force(ParticleProxy(probe, (int)(i - begin)), t);
+                forces[i * MC_DIMS] = f.x;
+                forces[i * MC_DIMS + 1] = f.y;
+                forces[i * MC_DIMS + 2] = f.z;
+            }
+        });
+    }
+
+}
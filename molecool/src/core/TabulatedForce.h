@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+#include "Ensemble.h"
+#include "Thruster.h"
+
+namespace molecool {
+
+    // an axis of a tabulation grid, points nodes evenly spaced over [from, to], a single point fixes the coordinate at
+    // from (the force is taken not to depend on it)
+    struct GridAxis {
+        double from = 0.0;
+        double to = 0.0;
+        int points = 1;
+    };
+
+    // an expensive static force (e.g. Bessel functions or multipole sums) sampled once onto a regular 1D, 2D or 3D grid
+    // of positions, in parallel, and replaced by trilinear interpolation of the samples during propagation
+    // the force is sampled at rest (zero velocity) at the time given, so it should only depend on the position, outside
+    // the grid the original function is called
+    // the interpolation error is measured at random points within the grid when tabulating, and logged
+    // copies share the table, e.g. addForce(TabulatedForce(multipole, { { { -1e-3, 1e-3, 65 }, { -1e-3, 1e-3, 65 }, { 0.2, 0.35, 301 } } }));
+    class TabulatedForce
+    {
+    public:
+        TabulatedForce(const ForceFunction& force, const std::array<GridAxis, MC_DIMS>& grid, double t = 0.0);
+
+        // the interpolated force, or the original one outside the grid
+        Force operator() (const ParticleProxy& pp, double t) const;
+
+        // the measured interpolation errors (absolute, the largest and the rms over the test points), and the largest
+        // magnitude of the tabulated force, for comparison
+        inline double getMaxError() const { return m_maxError; }
+        inline double getRmsError() const { return m_rmsError; }
+        inline double getMaxForce() const { return m_maxForce; }
+        inline bool isTabulated() const { return m_table != nullptr; }
+
+        static constexpr size_t s_maxNodes = size_t(1) << 26;     // 1.5 GB of samples
+        static constexpr int s_errorSamples = 4096;
+
+    private:
+        ForceFunction m_force;
+        std::array<GridAxis, MC_DIMS> m_grid;
+        std::array<double, MC_DIMS> m_inverseSpacing{};
+        std::array<size_t, MC_DIMS> m_stride{};         // 0 along single point axes
+        std::shared_ptr<const std::vector<double>> m_table;   // fx, fy, fz per node, the last axis fastest
+        double m_maxError = 0.0;
+        double m_rmsError = 0.0;
+        double m_maxForce = 0.0;
+
+        // sample the force at the nodes (in parallel)
+        void tabulate(double t);
+
+        // measure the interpolation error at random points within the grid
+        void measureError(double t);
+
+        // the interpolated force at pos, false if pos is outside the grid
+        bool interpolate(const double* pos, Force& f) const;
+
+        // evaluate the original force at the n positions (x, y, z each), in parallel
+        void sample(const std::vector<double>& positions, double t, std::vector<double>& forces) const;
+    };
+
+}
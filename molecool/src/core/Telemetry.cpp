@@ -0,0 +1,179 @@
+#include "mcpch.h"
+#include "Telemetry.h"
+
+#include <filesystem>
+#include <iomanip>
+
+#if defined(MC_PLATFORM_LINUX) || defined(MC_PLATFORM_MACOSX)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace molecool {
+
+    // resident and peak resident memory of the process (bytes), zero where unsupported
+    static double getResidentMemory() {
+#if defined(MC_PLATFORM_LINUX)
+        std::ifstream statm("/proc/self/statm");
+        double pages = 0.0, resident = 0.0;
+        if (statm >> pages >> resident) { return resident * (double)sysconf(_SC_PAGE_SIZE); }
+#endif
+        return 0.0;
+    }
+
+    static double getPeakMemory() {
+#if defined(MC_PLATFORM_LINUX)
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0) { return (double)usage.ru_maxrss * 1024.0; }     // kilobytes on Linux
+#elif defined(MC_PLATFORM_MACOSX)
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0) { return (double)usage.ru_maxrss; }              // bytes on macOS
+#endif
+        return 0.0;
+    }
+
+    Telemetry::Telemetry()
+    {}
+
+    Telemetry::~Telemetry() {
+        stop();
+    }
+
+    void Telemetry::configure(const std::string& filename, double period) {
+        m_filename = filename;
+        m_period = period > 0.0 ? period : 5.0;
+        m_enabled = true;
+        MC_CORE_TRACE("Telemetry to {0} every {1} s", m_filename, m_period);
+    }
+
+    void Telemetry::start(double t, double tEnd, double dt) {
+        if (!m_enabled) { return; }
+        stop();
+        m_steps = 0;
+        m_particleSteps = 0.0;
+        m_t = t;
+        m_phaseTimes.fill(0.0);
+        m_tEnd = tEnd;
+        m_dt = dt;
+        m_startTime = Clock::now();
+        m_nextPublish = m_startTime + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(m_period));
+        m_latest = Snapshot();
+        m_fresh = false;
+        m_stopReporter = false;
+        m_reporter = std::thread(&Telemetry::reporterLoop, this);
+    }
+
+    void Telemetry::stop() {
+        if (!m_reporter.joinable()) { return; }
+        publish();      // the final state
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopReporter = true;
+        }
+        m_condition.notify_one();
+        m_reporter.join();
+    }
+
+    // hand the current counters to the reporter
+    void Telemetry::publish() {
+        Clock::time_point now = Clock::now();
+        m_nextPublish = now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(m_period));
+        {
+            std::lock_guard lock(m_mutex);
+            m_latest.wallTime = std::chrono::duration<double>(now - m_startTime).count();
+            m_latest.steps = m_steps;
+            m_latest.particleSteps = m_particleSteps;
+            m_latest.t = m_t;
+            m_latest.population = m_population;
+            m_latest.phaseTimes = m_phaseTimes;
+            m_fresh = true;
+        }
+        m_condition.notify_one();
+    }
+
+    void Telemetry::reporterLoop() {
+        Snapshot previous;
+        std::unique_lock lock(m_mutex);
+        while (true) {
+            m_condition.wait(lock, [this] { return m_fresh || m_stopReporter; });
+            if (m_fresh) {
+                Snapshot current = m_latest;
+                m_fresh = false;
+                lock.unlock();
+                report(current, previous);
+                previous = current;
+                lock.lock();
+            }
+            if (m_stopReporter && !m_fresh) { break; }
+        }
+    }
+
+    void Telemetry::report(const Snapshot& current, const Snapshot& previous) {
+        // rolling rates over the last period, and averages since the start
+        double window = current.wallTime - previous.wallTime;
+        double stepRate = window > 0.0 ? (current.steps - previous.steps) / window : 0.0;
+        double particleStepRate = window > 0.0 ? (current.particleSteps - previous.particleSteps) / window : 0.0;
+        double meanStepRate = current.wallTime > 0.0 ? current.steps / current.wallTime : 0.0;
+        double meanParticleStepRate = current.wallTime > 0.0 ? current.particleSteps / current.wallTime : 0.0;
+        double stepsLeft = m_dt > 0.0 ? std::max(0.0, (m_tEnd - current.t) / m_dt) : 0.0;
+        double eta = stepRate > 0.0 ? stepsLeft / stepRate : (meanStepRate > 0.0 ? stepsLeft / meanStepRate : -1.0);
+        double resident = getResidentMemory();
+        double peak = getPeakMemory();
+
+        std::stringstream metrics;
+        metrics << std::setprecision(9);
+        auto gauge = [&](const char* name, const char* help, double value) {
+            metrics << "# HELP " << name << " " << help << "\n# TYPE " << name << " gauge\n" << name << " " << value << "\n";
+        };
+        auto counter = [&](const char* name, const char* help, double value) {
+            metrics << "# HELP " << name << " " << help << "\n# TYPE " << name << " counter\n" << name << " " << value << "\n";
+        };
+        counter("molecool_steps_total", "Timesteps propagated.", (double)current.steps);
+        counter("molecool_particle_steps_total", "Active particle-steps propagated.", current.particleSteps);
+        gauge("molecool_steps_per_second", "Timesteps per second over the last reporting period.", stepRate);
+        gauge("molecool_particle_steps_per_second", "Active particle-steps per second over the last reporting period.", particleStepRate);
+        gauge("molecool_steps_per_second_mean", "Timesteps per second since the start of propagation.", meanStepRate);
+        gauge("molecool_particle_steps_per_second_mean", "Active particle-steps per second since the start of propagation.", meanParticleStepRate);
+        gauge("molecool_simulation_time", "Current simulation time.", current.t);
+        gauge("molecool_simulation_end_time", "Simulation end time.", m_tEnd);
+        gauge("molecool_active_particles", "Active particles in the ensemble.", current.population);
+        gauge("molecool_eta_seconds", "Estimated wall-clock seconds until the end of propagation (-1 if unknown).", eta);
+        gauge("molecool_wall_seconds", "Wall-clock seconds since the start of propagation.", current.wallTime);
+        gauge("molecool_resident_memory_bytes", "Resident memory of the process.", resident);
+        gauge("molecool_peak_resident_memory_bytes", "Peak resident memory of the process.", peak);
+        metrics << "# HELP molecool_phase_seconds_total Wall-clock seconds spent in each phase of the step loop.\n";
+        metrics << "# TYPE molecool_phase_seconds_total counter\n";
+        for (int p = 0; p < (int)Phase::count; ++p) {
+            metrics << "molecool_phase_seconds_total{phase=\"" << phaseToName((Phase)p) << "\"} " << current.phaseTimes[p] << "\n";
+        }
+
+        // write to a temporary file and swap it in, so a scraper never reads a partial file
+        std::string tempname = m_filename + ".tmp";
+        std::ofstream outputStream(tempname);
+        if (!outputStream.is_open()) {
+            MC_CORE_ERROR("Telemetry could not open {0}", tempname);
+            return;
+        }
+        outputStream << metrics.str();
+        outputStream.close();
+        std::error_code ec;
+        std::filesystem::rename(tempname, m_filename, ec);
+        if (ec) {
+            MC_CORE_ERROR("Telemetry could not replace {0}: {1}", m_filename, ec.message());
+        }
+
+        MC_CORE_INFO("t = {0:.6g} / {1:.6g}: {2:.4g} steps/s, {3:.4g} particle-steps/s, {4} active, ETA {5:.0f} s, {6:.1f} MB",
+            current.t, m_tEnd, stepRate, particleStepRate, current.population, eta, resident / 1e6);
+    }
+
+    std::string Telemetry::phaseToName(Phase phase) {
+        switch (phase) {
+        case Phase::forces: return "forces";
+        case Phase::integrate: return "integrate";
+        case Phase::observe: return "observe";
+        case Phase::io: return "io";
+        default: return "unknown";
+        }
+    }
+
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <string>
+#include <array>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace molecool {
+
+    // live throughput metrics of a running simulation: steps/s, active particle-steps/s (over the last
+    // reporting period and since the start), the time split between the phases of a step, memory footprint
+    // and the estimated time to completion
+    // the step loop only adds up plain counters and reads the clock, every period (wall-clock seconds) a
+    // snapshot is handed to a background thread, which rewrites a Prometheus text exposition file (e.g. for
+    // the node exporter textfile collector) and logs a progress line, so the cost in the loop is negligible
+    class Telemetry
+    {
+    public:
+        enum class Phase { forces, integrate, observe, io, count };
+
+        using Clock = std::chrono::steady_clock;
+
+        Telemetry();
+        ~Telemetry();
+
+        // enable telemetry, metrics are written to filename every period seconds of wall-clock time
+        void configure(const std::string& filename, double period);
+        inline bool isEnabled() const { return m_enabled; }
+
+        // start/stop reporting for a propagation from simulation time t to tEnd with timestep dt
+        void start(double t, double tEnd, double dt);
+        void stop();
+
+        // called from the step loop (single thread)
+        inline void addPhaseTime(Phase phase, double seconds) { m_phaseTimes[(int)phase] += seconds; }
+        inline void endStep(double t, int population) {
+            m_steps++;
+            m_particleSteps += population;
+            m_t = t;
+            m_population = population;
+            if (m_enabled && Clock::now() >= m_nextPublish) { publish(); }
+        }
+
+        // measures the duration of a scope as time spent in a phase, a phase nested in another one (e.g. the
+        // force evaluations inside the integrator step) can give its enclosing phase, which is then not charged for it
+        // nothing is measured when telemetry is disabled
+        class PhaseTimer {
+        public:
+            PhaseTimer(Telemetry& telemetry, Phase phase, Phase enclosing = Phase::count)
+                : m_telemetry(telemetry), m_phase(phase), m_enclosing(enclosing), m_enabled(telemetry.isEnabled())
+            {
+                if (m_enabled) { m_start = Clock::now(); }
+            }
+            ~PhaseTimer() {
+                if (!m_enabled) { return; }
+                double elapsed = std::chrono::duration<double>(Clock::now() - m_start).count();
+                m_telemetry.addPhaseTime(m_phase, elapsed);
+                if (m_enclosing != Phase::count) { m_telemetry.addPhaseTime(m_enclosing, -elapsed); }
+            }
+        private:
+            Telemetry& m_telemetry;
+            Phase m_phase;
+            Phase m_enclosing;
+            bool m_enabled;
+            Clock::time_point m_start;
+        };
+
+    private:
+
+        // the metrics at one point in time
+        struct Snapshot {
+            double wallTime = 0.0;                  // seconds since start()
+            long long steps = 0;
+            double particleSteps = 0.0;
+            double t = 0.0;
+            int population = 0;
+            std::array<double, (int)Phase::count> phaseTimes{};
+        };
+
+        std::string m_filename = "output/metrics.prom";
+        double m_period = 5.0;
+        bool m_enabled = false;
+
+        // step loop counters
+        long long m_steps = 0;
+        double m_particleSteps = 0.0;
+        double m_t = 0.0;
+        int m_population = 0;
+        std::array<double, (int)Phase::count> m_phaseTimes{};
+        Clock::time_point m_startTime;
+        Clock::time_point m_nextPublish;
+        double m_tEnd = 0.0;
+        double m_dt = 0.0;
+
+        // background reporting
+        std::thread m_reporter;
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        Snapshot m_latest;                          // most recent snapshot, guarded by m_mutex
+        bool m_fresh = false;                       // a snapshot is waiting to be reported
+        bool m_stopReporter = false;
+
+        void publish();
+        void reporterLoop();
+        void report(const Snapshot& current, const Snapshot& previous);
+
+        static std::string phaseToName(Phase phase);
+    };
+
+}
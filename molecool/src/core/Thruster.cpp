@@ -1,5 +1,6 @@
 #include "mcpch.h"
 #include "Thruster.h"
+#include "Scheduler.h"
 
 namespace molecool {
 
@@ -17,8 +18,90 @@ namespace molecool {
 	{
 		MC_PROFILE_FUNCTION();
 		int nParticles = (int)x.size() / MC_DIMS;
-		#pragma omp parallel for
-		for (int i = 0; i < nParticles; ++i) {
+		prepare(t);
+		Scheduler::get().parallelFor(nParticles, [&](long long begin, long long end, int worker) {
+			evaluate(x, v, a, t, (int)begin, (int)end);
+		});
+		lostParticles.report(t);
+	} // end function
+
+	// accelerations of the particles [begin, end), serially, the building block of the parallel evaluation
+	void Thruster::evaluate(state_type const& x, state_type const& v, state_type& a, double t, int begin, int end)
+	{
+		const Coefficients* prepared = getPrepared(t);
+		if (chunkFilters.empty() && chunkForces.empty()) {
+			evaluateParticles(x, v, a, t, begin, end, nullptr, prepared);
+			return;
+		}
+		thread_local Chunk chunk;									// per thread, reused across calls
+		for (int first = begin; first < end; first += s_chunkSize) {
+			int n = std::min(s_chunkSize, end - first);
+			evaluateChunk(chunk, first, n, t);
+			evaluateParticles(x, v, a, t, first, first + n, &chunk, prepared);
+		}
+	}
+
+	// the chunk functions are called for the active particles of the chunk, their results are scattered to the chunk
+	void Thruster::evaluateChunk(Chunk& chunk, int first, int n, double t)
+	{
+		int m = 0;
+		for (int k = 0; k < n; ++k) {
+			if (ensemble.isParticleActive(first + k)) { chunk.particles[m++] = first + k; }
+		}
+		std::fill(chunk.stop, chunk.stop + n, 0.0);
+		std::fill(chunk.fx, chunk.fx + n, 0.0);
+		std::fill(chunk.fy, chunk.fy + n, 0.0);
+		std::fill(chunk.fz, chunk.fz + n, 0.0);
+		if (m == 0) { return; }
+		for (auto& cf : chunkFilters) {
+			cf(ensemble, chunk.particles, m, t, chunk.scratch[0]);
+			for (int j = 0; j < m; ++j) {
+				if (chunk.scratch[0][j] != 0.0) { chunk.stop[chunk.particles[j] - first] = 1.0; }
+			}
+		}
+		for (auto& cf : chunkForces) {
+			cf(ensemble, chunk.particles, m, t, chunk.scratch[0], chunk.scratch[1], chunk.scratch[2]);
+			for (int j = 0; j < m; ++j) {
+				int k = chunk.particles[j] - first;
+				chunk.fx[k] += chunk.scratch[0][j];
+				chunk.fy[k] += chunk.scratch[1][j];
+				chunk.fz[k] += chunk.scratch[2][j];
+			}
+		}
+	}
+
+	void Thruster::prepare(double t) {
+		if (stagedForces.empty()) { return; }
+		m_prepared.resize(stagedForces.size());
+		for (size_t k = 0; k < stagedForces.size(); ++k) {
+			m_prepared[k] = stagedForces[k].prepare(t);
+		}
+		m_preparedTime = t;
+	}
+
+	// blocked propagation evaluates the threads' blocks at different times, each thread keeps its own coefficients
+	// for the last time it saw
+	const Coefficients* Thruster::getPrepared(double t) {
+		if (stagedForces.empty()) { return nullptr; }
+		if (t == m_preparedTime) { return m_prepared.data(); }
+		thread_local std::vector<Coefficients> prepared;
+		thread_local const Thruster* owner = nullptr;
+		thread_local double preparedTime = std::numeric_limits<double>::quiet_NaN();
+		if (owner != this || preparedTime != t || prepared.size() != stagedForces.size()) {
+			prepared.resize(stagedForces.size());
+			for (size_t k = 0; k < stagedForces.size(); ++k) {
+				prepared[k] = stagedForces[k].prepare(t);
+			}
+			owner = this;
+			preparedTime = t;
+		}
+		return prepared.data();
+	}
+
+	void Thruster::evaluateParticles(state_type const& x, state_type const& v, state_type& a, double t, int begin, int end, const Chunk* chunk,
+		const Coefficients* prepared)
+	{
+		for (int i = begin; i < end; ++i) {
 			int j = MC_DIMS * i;									// particle index in x/v/a vectors
 			Velocity& vel = (Velocity&)v[j];						// some refs to reduce error-prone manual indexing below
 			Acceleration& acc = (Acceleration&)a[j];				// and improve readability
@@ -27,14 +110,15 @@ namespace molecool {
 			{	// particle not active, skip!
 				continue; 
 			}
-			else if (filter(p, t))
+			else if (filter(p, t) || (chunk && chunk->stop[i - begin] != 0.0))
 			{	// check if an active particle should be filtered
 				// filter actually evaluates as true 3 times before molecule is deactivated, allowing v,a to damp to zero before deactivation
 				vel.x = vel.y = vel.z = 0;				// set velocity to zero, breaking the const promise
 				if (acc.x == 0 && acc.y == 0.0 && acc.z == 0.0) 
 				{	// acceleration has properly damped to zero, OK to never change it again 
 					ensemble.deactivateParticle(i); 
-					MC_CORE_TRACE("particle lost @ ({0}, {1}, {2})", p.getX(), p.getY(), p.getZ());
+					lostParticles.count();
+					MC_CORE_TRACE_LIMITED(1.0, "particle lost @ ({0}, {1}, {2})", p.getX(), p.getY(), p.getZ());
 				}
 				else 
 				{	// particle matches filter condition but acceleration hasn't reached zero yet due to odeint internal state 
@@ -43,11 +127,12 @@ namespace molecool {
 			}
 			else 
 			{	// normal propagation
-				acc = getTotalForce(p, t) / p.getMass();
+				Force f = getTotalForce(p, t, prepared);
+				if (chunk) { f += Force(chunk->fx[i - begin], chunk->fy[i - begin], chunk->fz[i - begin]); }
+				acc = f / p.getMass();
 			}
-			int d = 2;
 		} // end for all particles
-	} // end function
+	}
 
 	void Thruster::addFilter(const FilterFunction& fil) {
 		MC_CORE_TRACE("Adding filter");
@@ -66,11 +151,30 @@ namespace molecool {
 		forces.push_back(f);
 	}
 
-	inline Force Thruster::getTotalForce(const ParticleProxy& pp, double t) {
+	void Thruster::addChunkFilter(const ChunkFilterFunction& cf) {
+		MC_CORE_TRACE("Adding chunk filter");
+		chunkFilters.push_back(cf);
+	}
+
+	void Thruster::addChunkForce(const ChunkForceFunction& cf) {
+		MC_CORE_TRACE("Adding chunk force");
+		chunkForces.push_back(cf);
+	}
+
+	void Thruster::addStagedForce(const PrepareFunction& prepare, const StagedForceFunction& force) {
+		MC_CORE_TRACE("Adding staged force");
+		stagedForces.push_back({ prepare, force });
+		m_preparedTime = std::numeric_limits<double>::quiet_NaN();
+	}
+
+	inline Force Thruster::getTotalForce(const ParticleProxy& pp, double t, const Coefficients* prepared) {
 		Force f;
 		for (auto& ff : forces) {
 			f += ff(pp, t);
 		}
+		for (size_t k = 0; k < stagedForces.size(); ++k) {
+			f += stagedForces[k].force(pp, prepared[k]);
+		}
 		return f;
 	}
 
@@ -8,6 +8,18 @@ namespace molecool {
     using FilterFunction = std::function< bool(const ParticleProxy& /*particle*/, double /*t*/) >;
     using ForceFunction = std::function< Force(const ParticleProxy& /*particle*/, double /*t*/) >;
 
+    // filters and forces evaluated for many particles at once (e.g. compiled expressions, see Expression), the particles
+    // are given by their indices particles[0...n), a filter writes n values (nonzero stops the particle), a force writes
+    // n values per component
+    using ChunkFilterFunction = std::function< void(const Ensemble& /*ens*/, const int* /*particles*/, int /*n*/, double /*t*/, double* /*stop*/) >;
+    using ChunkForceFunction = std::function< void(const Ensemble& /*ens*/, const int* /*particles*/, int /*n*/, double /*t*/, double* /*fx*/, double* /*fy*/, double* /*fz*/) >;
+
+    // time-dependent forces split in two stages: prepare computes the coefficients that depend on time only (switching
+    // schedules, pulse envelopes, ...) once per evaluation of the system, the force then only does the spatial work
+    using Coefficients = std::array<double, 8>;
+    using PrepareFunction = std::function< Coefficients(double /*t*/) >;
+    using StagedForceFunction = std::function< Force(const ParticleProxy& /*particle*/, const Coefficients& /*c*/) >;
+
 
     // a functor that knows how to calculate accelerations for particles in the simulation
     class Thruster
@@ -20,8 +32,21 @@ namespace molecool {
 		// odeint system function, signature is specific to 2nd order system for velocity-verlet stepper
 		void operator() (state_type const& x, state_type const& v, state_type& a, double t);
 
+		// accelerations of the particles [begin, end) only, serially (e.g. for blocked propagation), losses are reported separately
+		void evaluate(state_type const& x, state_type const& v, state_type& a, double t, int begin, int end);
+		inline void reportLosses(double t) { lostParticles.report(t); }
+
         void addFilter(const FilterFunction& ff);
         void addForce(const ForceFunction& ff);
+        void addChunkFilter(const ChunkFilterFunction& cf);
+        void addChunkForce(const ChunkForceFunction& cf);
+        void addStagedForce(const PrepareFunction& prepare, const StagedForceFunction& force);
+
+        // run the prepare stages of the staged forces for time t, done by the system function before its particle loop,
+        // evaluate prepares by itself for other times
+        void prepare(double t);
+
+        static constexpr int s_chunkSize = 256;     // particles per call of the chunk filters and forces
 
     private:
 
@@ -33,11 +58,44 @@ namespace molecool {
         // a collection of force functions that apply forces based on position, velocity, etc.
         std::vector<ForceFunction> forces;
 
+        // filters and forces evaluated per chunk of particles, their results are combined with the per-particle ones
+        std::vector<ChunkFilterFunction> chunkFilters;
+        std::vector<ChunkForceFunction> chunkForces;
+
+        // forces with a per-evaluation prepare stage, and their coefficients for m_preparedTime
+        struct StagedForce {
+            PrepareFunction prepare;
+            StagedForceFunction force;
+        };
+        std::vector<StagedForce> stagedForces;
+        std::vector<Coefficients> m_prepared;
+        double m_preparedTime = std::numeric_limits<double>::quiet_NaN();
+
+        // the combined chunk results for the particles [first, first + s_chunkSize), per thread
+        struct Chunk {
+            int particles[s_chunkSize];             // the active particles of the chunk, passed to the chunk functions
+            double stop[s_chunkSize], fx[s_chunkSize], fy[s_chunkSize], fz[s_chunkSize];
+            double scratch[MC_DIMS][s_chunkSize];
+        };
+
+        // particles lost (deactivated), counted in the parallel loop and logged once per call
+        LogCounter lostParticles{ "particles lost" };
+
+        // evaluate the chunk filters and forces for the n particles from first
+        void evaluateChunk(Chunk& chunk, int first, int n, double t);
+
+        // accelerations of the particles [begin, end), with the chunk results for them if chunk is not null
+        void evaluateParticles(state_type const& x, state_type const& v, state_type& a, double t, int begin, int end, const Chunk* chunk,
+            const Coefficients* prepared);
+
+        // the prepared coefficients for time t, from prepare if it was run for t, else prepared for this thread
+        const Coefficients* getPrepared(double t);
+
         // apply all filter tests
         inline bool filter(const ParticleProxy& pp, double t);
 
         // get sum of all acting forces
-        inline Force getTotalForce(const ParticleProxy& pp, double t);
+        inline Force getTotalForce(const ParticleProxy& pp, double t, const Coefficients* prepared);
 
     };
 
@@ -9,15 +9,126 @@ namespace molecool {
 
     void Watcher::deployObservers(const Ensemble& ens, double t) {
         MC_PROFILE_FUNCTION();
-        for (const auto& obs : observers) {
-            (*obs)(ens, t);
+        for (auto& dep : observers) {
+            if (dep.always || isDue(dep, ens, t)) {
+                (*dep.observer)(ens, t);
+            }
         }
+        m_step++;
     }
 
-    void Watcher::addObserver(ObserverPtr obs) {
+    void Watcher::addObserver(ObserverPtr obs, const Schedule& schedule) {
         MC_CORE_TRACE("Adding observer");
-        observers.push_back(obs);
+        Deployment dep;
+        dep.observer = obs;
+        dep.schedule = schedule;
+        dep.always = schedule.isTrivial();
+        observers.push_back(dep);
     }
 
+    int Watcher::getStepsToSync(double t, double dt, int maxSteps) const {
+        for (int j = 0; j < maxSteps; ++j, t += dt) {
+            for (const auto& dep : observers) {
+                if (mayBeDue(dep, m_step + j, t)) { return j + 1; }
+            }
+        }
+        return std::max(1, maxSteps);
+    }
+
+    bool Watcher::mayBeDue(const Deployment& dep, long long step, double t) const {
+        const Schedule& s = dep.schedule;
+        if (dep.always || s.populationBelow >= 0 || s.populationAbove >= 0 || s.trigger) { return true; }
+        if (t < s.from || t > s.to) { return false; }
+        if (step < dep.nextStep) { return false; }
+        if (s.interval > 0.0 && t < dep.nextTime - 1e-9 * s.interval) { return false; }
+        return true;
+    }
+
+    void Watcher::restart() {
+        m_step = 0;
+        for (auto& dep : observers) {
+            dep.nextStep = 0;
+            dep.nextTime = -std::numeric_limits<double>::infinity();
+        }
+    }
+
+    void Watcher::writeResults(const std::string& dir) {
+        MC_PROFILE_FUNCTION();
+        for (auto& dep : observers) { dep.observer->writeResults(dir); }
+    }
+
+    void Watcher::resetObservers() {
+        for (auto& dep : observers) { dep.observer->reset(); }
+        restart();
+    }
+
+    std::vector<Observer::Summary> Watcher::getSummaries() {
+        std::vector<Observer::Summary> summaries;
+        summaries.reserve(observers.size());
+        for (auto& dep : observers) { summaries.push_back(dep.observer->getSummary()); }
+        return summaries;
+    }
+
+    void Watcher::setWriteOnDestruction(bool enable) {
+        for (auto& dep : observers) { dep.observer->setWriteOnDestruction(enable); }
+    }
+
+    void Watcher::start(const Ensemble& ens, double t, double dt) {
+        for (auto& dep : observers) { dep.observer->start(ens, t, dt); }
+    }
+
+    void Watcher::beginBatch(long long batch, long long firstParticle) {
+        restart();
+        for (auto& dep : observers) { dep.observer->beginBatch(batch, firstParticle); }
+    }
+
+    void Watcher::saveState(BinaryWriter& out) const {
+        out.write<uint64_t>(observers.size());
+        out.write(m_step);
+        for (const auto& dep : observers) {
+            out.write(dep.nextStep);
+            out.write(dep.nextTime);
+            dep.observer->saveState(out);
+        }
+    }
+
+    bool Watcher::loadState(BinaryReader& in) {
+        uint64_t nObservers = 0;
+        in.read(nObservers);
+        if (nObservers != observers.size()) {
+            MC_CORE_ERROR("Checkpoint holds {0} observers, simulation has {1}", nObservers, observers.size());
+            return false;
+        }
+        in.read(m_step);
+        for (auto& dep : observers) {
+            in.read(dep.nextStep);
+            in.read(dep.nextTime);
+            dep.observer->loadState(in);
+        }
+        return in.isGood();
+    }
+
+    inline bool Watcher::isDue(Deployment& dep, const Ensemble& ens, double t) {
+        const Schedule& s = dep.schedule;
+
+        // active time window and triggers first, decimation counts from the first eligible deployment
+        if (t < s.from || t > s.to) { return false; }
+        if (s.populationBelow >= 0 && ens.getPopulation() >= s.populationBelow) { return false; }
+        if (s.populationAbove >= 0 && ens.getPopulation() <= s.populationAbove) { return false; }
+        if (s.trigger && !s.trigger(ens, t)) { return false; }
+
+        // step decimation
+        if (m_step < dep.nextStep) { return false; }
+
+        // time decimation, allowing for round-off in the accumulated simulation time
+        if (s.interval > 0.0) {
+            if (t < dep.nextTime - 1e-9 * s.interval) { return false; }
+            dep.nextTime = (dep.nextTime == -std::numeric_limits<double>::infinity()) ? t : dep.nextTime;
+            while (dep.nextTime <= t + 1e-9 * s.interval) { dep.nextTime += s.interval; }
+        }
+
+        dep.nextStep = m_step + std::max(1, s.everySteps);
+        return true;
+    }
 
 }
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <limits>
+#include <map>
 #include "Ensemble.h"
+#include "Serialization.h"
 
 namespace molecool {
 
@@ -11,10 +14,59 @@ namespace molecool {
     public:
         virtual ~Observer() = default;
         virtual void operator()(const Ensemble& ens, double t) = 0;	    // pure virtual, must be implemented in child classes
+
+        // checkpoint support, observers that accumulate results must save and restore them
+        virtual void saveState(BinaryWriter& out) const {}
+        virtual void loadState(BinaryReader& in) {}
+
+        // out-of-core runs propagate the ensemble in batches, each from the start time, the results for a new batch
+        // are folded into those of the previous ones, its particle i is particle firstParticle + i of the whole ensemble
+        virtual void beginBatch(long long batch, long long firstParticle) {}
+
+        // the initial ensemble at time t, before the first step of a propagation with timestep dt (not when resuming)
+        // a deployment labelled t sees the ensemble at the end of the step from t, i.e. at t + dt
+        virtual void start(const Ensemble& ens, double t, double dt) {}
+
+        // write the results to files in the directory dir, and discard them (e.g. between the points of a sweep)
+        // an observer writes its results to output/ when it is destroyed, unless that is disabled
+        virtual void writeResults(const std::string& dir) {}
+        virtual void reset() {}
+
+        // a few named scalars summarizing the current results (e.g. the final population), for objective functions
+        using Summary = std::map<std::string, double>;
+        virtual Summary getSummary() { return Summary(); }
+
+        inline void setWriteOnDestruction(bool enable) { m_writeOnDestruction = enable; }
+        inline bool isWrittenOnDestruction() const { return m_writeOnDestruction; }
+
+    private:
+        bool m_writeOnDestruction = true;
+    };
+
+    using TriggerFunction = std::function< bool(const Ensemble& /*ensemble*/, double /*t*/) >;
+
+    // describes when an observer should be deployed, the default schedule deploys at every timestep
+    // decimation (every N steps or every interval of simulation time), the active time window and
+    // the triggers can be combined, all conditions must be satisfied for the observer to be deployed
+    struct Schedule {
+        int everySteps = 1;                                             // deploy every N steps
+        double interval = 0.0;                                          // deploy every interval of simulation time (ignored if <= 0)
+        double from = -std::numeric_limits<double>::infinity();         // active time window start
+        double to = std::numeric_limits<double>::infinity();            // active time window end
+        int populationBelow = -1;                                       // trigger: only deploy while population < value (ignored if < 0)
+        int populationAbove = -1;                                       // trigger: only deploy while population > value (ignored if < 0)
+        TriggerFunction trigger;                                        // trigger: arbitrary (C++) condition
+        // in out-of-core (batched) runs the population triggers would see the population of a batch only, they are not
+        // supported there, results of the batches are merged by deployment time
+
+        // true if the observer is deployed at every timestep, i.e. no schedule checks are required
+        bool isTrivial() const {
+            return everySteps <= 1 && interval <= 0.0 && populationBelow < 0 && populationAbove < 0 && !trigger
+                && from == -std::numeric_limits<double>::infinity() && to == std::numeric_limits<double>::infinity();
+        }
     };
 
 
-    
     class Watcher
     {
     public:
@@ -22,14 +74,62 @@ namespace molecool {
 
         void deployObservers(const Ensemble& ens, double t);
 
-        void addObserver(ObserverPtr obs);
+        void addObserver(ObserverPtr obs, const Schedule& schedule = Schedule());
+
+        // synchronization points for blocked propagation: the number of steps (1...maxSteps) that can be taken
+        // before the observers must see the ensemble again, i.e. the last of them is the first step after which an
+        // observer may be deployed (deployments are labelled t, t + dt, ..., accumulated like the simulation time)
+        // population conditions and triggers depend on the whole ensemble, such observers synchronize every step
+        int getStepsToSync(double t, double dt, int maxSteps) const;
+
+        // account for steps after which no observer was due (see getStepsToSync)
+        inline void skipSteps(int n) { m_step += n; }
+
+        // restart the deployment schedules (e.g. for the next point of a sweep), the observers keep their results
+        void restart();
+
+        // write the observers' results to the directory dir and reset them, see Observer::writeResults
+        void writeResults(const std::string& dir);
+        void resetObservers();
+        void setWriteOnDestruction(bool enable);
+
+        // the observers' summaries, in the order the observers were added
+        std::vector<Observer::Summary> getSummaries();
+
+        // restart the deployment schedules for the next batch of an out-of-core run (see Observer::beginBatch)
+        void beginBatch(long long batch, long long firstParticle);
+
+        // show the observers the initial ensemble, see Observer::start
+        void start(const Ensemble& ens, double t, double dt);
+
+        // checkpoint support, restoring requires the same observers to have been added in the same order
+        void saveState(BinaryWriter& out) const;
+        bool loadState(BinaryReader& in);
 
     private:
 
+        // an observer along with its deployment schedule and bookkeeping
+        struct Deployment {
+            ObserverPtr observer;
+            Schedule schedule;
+            bool always;                // cached Schedule::isTrivial()
+            long long nextStep = 0;     // next step eligible for deployment (step decimation)
+            double nextTime = -std::numeric_limits<double>::infinity();   // next time eligible for deployment (time decimation)
+        };
+
+        // check (and update the bookkeeping of) the deployment schedule
+        inline bool isDue(Deployment& dep, const Ensemble& ens, double t);
+
+        // true unless the observer certainly won't be deployed at the given step and time (no bookkeeping updates)
+        bool mayBeDue(const Deployment& dep, long long step, double t) const;
+
         const Ensemble& ensemble;
 
         // a collection of observers
-        std::vector<ObserverPtr> observers;
+        std::vector<Deployment> observers;
+
+        // number of times the observers have been deployed, i.e. the step count
+        long long m_step = 0;
 
     };
 }
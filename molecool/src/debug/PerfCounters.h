@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace molecool {
+
+	// hardware events counted per profile scope, in output order
+	enum class PerfEvent { cycles = 0, instructions, llcMisses, branchMisses };
+	static constexpr int MC_PERF_EVENTS = 4;
+
+	using PerfValues = std::array<uint64_t, MC_PERF_EVENTS>;
+
+	// a group of hardware performance counters of the calling thread (Linux perf_event_open), counting user space only
+	// the counters run freely once opened, a scope's counts are the difference of two reads, just like wall time
+	// when the kernel refuses (no PMU, e.g. in a VM, or perf_event_paranoid too high) the group is simply unavailable
+	// and reads fail, so callers fall back to timing only; single events that are not supported are left at zero
+	// when the kernel multiplexes the counters (more events than hardware counters) the group only counts part of the
+	// time, the counts are scaled by the ratio of the enabled to the running time, so they estimate the full counts
+	class PerfCounters
+	{
+	public:
+		PerfCounters() { m_fds.fill(-1); }
+		~PerfCounters() { close(); }
+		PerfCounters(const PerfCounters&) = delete;
+		PerfCounters& operator=(const PerfCounters&) = delete;
+
+		// open the counters for the calling thread, returns whether at least the cycle counter is available
+		bool open() {
+#if defined(__linux__)
+			close();
+			static const uint64_t configs[MC_PERF_EVENTS] = {
+				PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+			};
+			for (int e = 0; e < MC_PERF_EVENTS; ++e) {
+				perf_event_attr attr;
+				std::memset(&attr, 0, sizeof(attr));
+				attr.size = sizeof(attr);
+				attr.type = PERF_TYPE_HARDWARE;
+				attr.config = configs[e];
+				attr.exclude_kernel = 1;
+				attr.exclude_hv = 1;
+				attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+				int leader = m_fds[0];
+				int fd = (int)syscall(SYS_perf_event_open, &attr, 0 /* this thread */, -1 /* any cpu */, leader, 0);
+				if (fd < 0) {
+					if (e == 0) { return false; }		// without the group leader there are no counters at all
+					continue;
+				}
+				m_fds[e] = fd;
+				ioctl(fd, PERF_EVENT_IOC_ID, &m_ids[e]);
+			}
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		void close() {
+#if defined(__linux__)
+			for (auto& fd : m_fds) {
+				if (fd >= 0) { ::close(fd); }
+				fd = -1;
+			}
+#endif
+		}
+
+		inline bool isOpen() const { return m_fds[0] >= 0; }
+
+		// current counts of all events of the group, with a single system call
+		bool read(PerfValues& values) const {
+#if defined(__linux__)
+			if (!isOpen()) { return false; }
+			// layout for PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING:
+			// nr, time enabled, time running, then { value, id } per event
+			uint64_t buffer[3 + 2 * MC_PERF_EVENTS];
+			if (::read(m_fds[0], buffer, sizeof(buffer)) <= 0) { return false; }
+			values.fill(0);
+			uint64_t nr = buffer[0];
+			uint64_t enabled = buffer[1];
+			uint64_t running = buffer[2];
+			if (running == 0) { return true; }				// the group has not been scheduled yet
+			double scale = running < enabled ? (double)enabled / (double)running : 1.0;
+			for (uint64_t k = 0; k < nr && k < MC_PERF_EVENTS; ++k) {
+				uint64_t value = scale == 1.0 ? buffer[3 + 2 * k] : (uint64_t)(buffer[3 + 2 * k] * scale);
+				uint64_t id = buffer[4 + 2 * k];
+				for (int e = 0; e < MC_PERF_EVENTS; ++e) {
+					if (m_fds[e] >= 0 && m_ids[e] == id) { values[e] = value; break; }
+				}
+			}
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		// check whether counters can be used at all (without keeping them open)
+		static bool probe() {
+			PerfCounters counters;
+			return counters.open();
+		}
+
+	private:
+		std::array<int, MC_PERF_EVENTS> m_fds;
+		std::array<uint64_t, MC_PERF_EVENTS> m_ids{};
+	};
+
+}
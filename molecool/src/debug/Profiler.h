@@ -2,6 +2,7 @@
 
 #define MC_PROFILE 1			// enable/disable global profiling/timers (statistics outputs enabled)
 #define MC_PROFILE_VERBOSE 0	// enable/disable detailed profile .json output (along with statistics)
+#define MC_PROFILE_COUNTERS 0	// enable/disable hardware performance counters per scope (Linux only, falls back to timing only)
 
 #if MC_PROFILE
 // Resolve which function signature macro will be used. Note that this only
@@ -25,13 +26,17 @@
 #define MC_FUNC_SIG "MC_FUNC_SIG unknown!"
 #endif
 
+// each profile scope is interned once (thread-safe function-local static), timers then only carry an integer id
 #define MC_PROFILE_BEGIN_SESSION(name) ::molecool::Profiler::get().beginSession(name)
 #define MC_PROFILE_END_SESSION() ::molecool::Profiler::get().endSession()
-#define MC_PROFILE_SCOPE(name) constexpr auto fixedName = ::molecool::ProfilerUtils::cleanupOutputString(name, "__cdecl ");\
-									::molecool::Timer timer##__LINE__(fixedName.data)
+#define MC_PROFILE_SCOPE_LINE2(name, line) constexpr auto fixedName##line = ::molecool::ProfilerUtils::cleanupOutputString(name, "__cdecl ");\
+									static const ::molecool::ProfileScope scope##line = ::molecool::Profiler::get().intern(fixedName##line.data);\
+									::molecool::Timer timer##line(scope##line)
+#define MC_PROFILE_SCOPE_LINE(name, line) MC_PROFILE_SCOPE_LINE2(name, line)
+#define MC_PROFILE_SCOPE(name) MC_PROFILE_SCOPE_LINE(name, __LINE__)
 #define MC_PROFILE_FUNCTION() MC_PROFILE_SCOPE(MC_FUNC_SIG)
 #else
-#define MC_PROFILE_BEGIN_SESSION(name, filepath)
+#define MC_PROFILE_BEGIN_SESSION(name)
 #define MC_PROFILE_END_SESSION()
 #define MC_PROFILE_SCOPE(name)
 #define MC_PROFILE_FUNCTION()
@@ -45,52 +50,76 @@
 #include <string>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <vector>
+#include <atomic>
 
-#include <boost/accumulators/accumulators.hpp>
-#include <boost/accumulators/statistics/stats.hpp>
-#include <boost/accumulators/statistics/mean.hpp>
-#include <boost/accumulators/statistics/min.hpp>
-#include <boost/accumulators/statistics/max.hpp>
-#include <boost/accumulators/statistics/sum.hpp>
+#include "PerfCounters.h"
 
 namespace molecool {
 
 	using FloatingPointMicroseconds = std::chrono::duration<double, std::micro>;
 
-	// accumulator for statistics associated with a particular profile timer
+	// an interned profile scope, the name lives as long as the profiler
+	struct ProfileScope {
+		uint32_t id;
+		const char* name;
+	};
+
+	// statistics associated with a particular profile scope
 	struct TimerStats {
-		TimerStats(std::string name, double time)
-		: name(name)
-		{
-			acc(time);
+		size_t count = 0;
+		double sum = 0.0;
+		double min = std::numeric_limits<double>::infinity();
+		double max = 0.0;
+		size_t counterCount = 0;		// number of calls with hardware counts
+		PerfValues counterSums{};
+
+		inline void addData(double t/* time (us) */) {
+			count++;
+			sum += t;
+			min = std::min(min, t);
+			max = std::max(max, t);
 		}
-
-		std::string name;
-		boost::accumulators::accumulator_set<
-			double,
-			boost::accumulators::stats <
-			boost::accumulators::tag::count,
-			boost::accumulators::tag::min,
-			boost::accumulators::tag::mean,
-			boost::accumulators::tag::max,
-			boost::accumulators::tag::sum
-			>
-		> acc;
-
-		inline void addData(double t/* time (us) */) { acc(t); }
-		inline double getMean() { return boost::accumulators::mean(acc); }
-		inline double getMin() { return boost::accumulators::extract_result< boost::accumulators::tag::min >(acc); }
-		inline double getMax() { return boost::accumulators::extract_result< boost::accumulators::tag::max >(acc); }
-		inline size_t getCount() { return boost::accumulators::count(acc); }
-		inline double getSum() { return boost::accumulators::sum(acc); }
+		inline void addCounters(const PerfValues& counts) {
+			counterCount++;
+			for (int e = 0; e < MC_PERF_EVENTS; ++e) { counterSums[e] += counts[e]; }
+		}
+		inline void merge(const TimerStats& other) {
+			count += other.count;
+			sum += other.sum;
+			min = std::min(min, other.min);
+			max = std::max(max, other.max);
+			counterCount += other.counterCount;
+			for (int e = 0; e < MC_PERF_EVENTS; ++e) { counterSums[e] += other.counterSums[e]; }
+		}
+		inline double getCounterMean(PerfEvent e) const { return counterCount > 0 ? (double)counterSums[(int)e] / counterCount : 0.0; }
+		inline double getMean() const { return count > 0 ? sum / count : 0.0; }
+		inline double getMin() const { return count > 0 ? min : 0.0; }
+		inline double getMax() const { return max; }
+		inline size_t getCount() const { return count; }
+		inline double getSum() const { return sum; }
 	};
 
 	struct ProfileResult
 	{
-		std::string name;
+		const char* name;
 		FloatingPointMicroseconds start;
-		std::chrono::microseconds elapsedTime;
-		std::thread::id threadID;
+		FloatingPointMicroseconds elapsedTime;
+		uint32_t threadIndex;
+	};
+
+	// per-thread profiling buffers, only ever touched by the owning thread while a session is running
+	// the profiler owns them, so results of threads that have finished are not lost
+	struct ThreadProfile {
+		uint32_t threadIndex;
+		std::vector<TimerStats> stats;			// indexed by scope id
+		std::vector<ProfileResult> events;		// trace events not yet handed to the writer
+		PerfCounters counters;					// hardware counters of the thread (if enabled and available)
+		bool countersTried = false;
 	};
 
 
@@ -100,20 +129,42 @@ namespace molecool {
 	};
 
 
+	// Timers record into lock-free per-thread buffers. Per-thread statistics are merged when the session ends,
+	// and (verbose mode) trace events are handed to a background writer in batches, so the only locking is
+	// once per scope (interning), once per thread (registration) and once per batch of events
+	// Note: sessions must be begun and ended while no other thread is profiling (i.e. outside parallel regions)
 	class Profiler
 	{
 	private:
 		std::mutex m_mutex;
 		ProfilerSession* m_currentSession;
+		std::atomic<bool> m_active{ false };						// timers only record while a session is open
+		bool m_countersAvailable = false;
 		std::ofstream m_outputStream;
 		std::ofstream m_statsStream;
-		std::vector<molecool::TimerStats> m_stats;
+		std::deque<std::string> m_names;						// interned scope names, indexed by scope id (deque: stable references)
+		std::vector<std::unique_ptr<ThreadProfile>> m_threads;
+
+		// background trace writer
+		std::thread m_writer;
+		std::mutex m_queueMutex;
+		std::condition_variable m_queueCondition;
+		std::deque<std::vector<ProfileResult>> m_queue;
+		bool m_stopWriter = false;
+
+		static constexpr size_t s_eventBatchSize = 4096;
+
 	public:
 		Profiler()
 			: m_currentSession(nullptr)
 		{
 		}
 
+		~Profiler()
+		{
+			endSession();
+		}
+
 		void beginSession(const std::string& name)
 		{
 			std::lock_guard lock(m_mutex);
@@ -138,6 +189,17 @@ namespace molecool {
 			{
 				m_currentSession = new ProfilerSession({ name });
 				writeHeader();
+				if (MC_PROFILE_COUNTERS) {
+					m_countersAvailable = PerfCounters::probe();
+					if (!m_countersAvailable && Log::getCoreLogger()) {
+						MC_CORE_WARN("Hardware performance counters unavailable (check /proc/sys/kernel/perf_event_paranoid), profiling time only");
+					}
+				}
+				if (MC_PROFILE_VERBOSE) {
+					m_stopWriter = false;
+					m_writer = std::thread(&Profiler::writerLoop, this);
+				}
+				m_active.store(true, std::memory_order_release);
 			}
 			else
 			{
@@ -154,41 +216,63 @@ namespace molecool {
 			internalEndSession();
 		}
 
-		void writeProfile(const ProfileResult& result)
+		// register a scope name, called once per profile scope
+		ProfileScope intern(const char* name)
 		{
-			std::stringstream json;
-			json << std::setprecision(3) << std::fixed;
-			json << ",{";
-			json << "\"cat\":\"function\",";
-			json << "\"dur\":" << (result.elapsedTime.count()) << ',';
-			json << "\"name\":\"" << result.name << "\",";
-			json << "\"ph\":\"X\",";
-			json << "\"pid\":0,";
-			json << "\"tid\":" << result.threadID << ",";
-			json << "\"ts\":" << result.start.count();
-			json << "}";
-
 			std::lock_guard lock(m_mutex);
-			if (m_currentSession)
-			{
-				m_outputStream << json.str();
-				m_outputStream.flush();
+			auto it = std::find(m_names.begin(), m_names.end(), name);
+			if (it == m_names.end()) {
+				m_names.emplace_back(name);
+				it = m_names.end() - 1;
 			}
+			return ProfileScope{ (uint32_t)(it - m_names.begin()), it->c_str() };
+		}
+
+		// the calling thread's buffers, registered on first use
+		ThreadProfile& getThreadProfile()
+		{
+			thread_local ThreadProfile* t_profile = nullptr;
+			if (!t_profile) {
+				std::lock_guard lock(m_mutex);
+				m_threads.push_back(std::make_unique<ThreadProfile>());
+				t_profile = m_threads.back().get();
+				t_profile->threadIndex = (uint32_t)m_threads.size() - 1;
+			}
+			return *t_profile;
+		}
+
+		void accumulate(ThreadProfile& tp, const ProfileScope& scope, double time)
+		{
+			if (scope.id >= tp.stats.size()) { tp.stats.resize(scope.id + 1); }
+			tp.stats[scope.id].addData(time);
+		}
+
+		void accumulateCounters(ThreadProfile& tp, const ProfileScope& scope, const PerfValues& counts)
+		{
+			if (scope.id >= tp.stats.size()) { tp.stats.resize(scope.id + 1); }
+			tp.stats[scope.id].addCounters(counts);
 		}
 
-		void accumulate(const std::string name, double time)
+		// read the calling thread's hardware counters, opening them on first use, false if unavailable
+		bool readCounters(ThreadProfile& tp, PerfValues& values)
 		{
-			auto it = std::find_if(m_stats.begin(), m_stats.end(), [&name](const TimerStats& obj) {return obj.name == name; });
-			if (it != m_stats.end()) {
-				// this timer has previously reported, add the data value
-				it->addData(time);
+			if (!tp.countersTried) {
+				tp.countersTried = true;
+				if (m_countersAvailable) { tp.counters.open(); }
 			}
-			else {
-				// first time this timer has reported a value
-				m_stats.push_back(TimerStats(name, time));
+			return tp.counters.read(values);
+		}
+
+		void writeProfile(ThreadProfile& tp, const ProfileResult& result)
+		{
+			tp.events.push_back(result);
+			if (tp.events.size() >= s_eventBatchSize) {
+				submitEvents(tp.events);
 			}
 		}
 
+		inline bool isActive() const { return m_active.load(std::memory_order_relaxed); }
+
 		static Profiler& get()
 		{
 			static Profiler instance;
@@ -197,6 +281,53 @@ namespace molecool {
 
 	private:
 
+		// hand a batch of events to the background writer, leaving an empty buffer behind
+		void submitEvents(std::vector<ProfileResult>& events)
+		{
+			std::vector<ProfileResult> batch;
+			batch.reserve(s_eventBatchSize);
+			std::swap(batch, events);
+			{
+				std::lock_guard lock(m_queueMutex);
+				m_queue.push_back(std::move(batch));
+			}
+			m_queueCondition.notify_one();
+		}
+
+		void writerLoop()
+		{
+			std::unique_lock lock(m_queueMutex);
+			while (true) {
+				m_queueCondition.wait(lock, [this] { return m_stopWriter || !m_queue.empty(); });
+				while (!m_queue.empty()) {
+					std::vector<ProfileResult> batch = std::move(m_queue.front());
+					m_queue.pop_front();
+					lock.unlock();
+					writeEvents(batch);
+					lock.lock();
+				}
+				if (m_stopWriter) { break; }
+			}
+		}
+
+		void writeEvents(const std::vector<ProfileResult>& batch)
+		{
+			std::stringstream json;
+			json << std::setprecision(3) << std::fixed;
+			for (const auto& result : batch) {
+				json << ",{";
+				json << "\"cat\":\"function\",";
+				json << "\"dur\":" << (result.elapsedTime.count()) << ',';
+				json << "\"name\":\"" << result.name << "\",";
+				json << "\"ph\":\"X\",";
+				json << "\"pid\":0,";
+				json << "\"tid\":" << result.threadIndex << ",";
+				json << "\"ts\":" << result.start.count();
+				json << "}";
+			}
+			m_outputStream << json.str();
+		}
+
 		void writeHeader()
 		{
 			m_outputStream << "{\"otherData\": {},\"traceEvents\":[{}";
@@ -210,25 +341,49 @@ namespace molecool {
 		}
 
 		void writeStatistics() {
-			for (TimerStats tStats : m_stats) {
+			// merge per-thread statistics, per scope
+			std::vector<TimerStats> totals(m_names.size());
+			std::vector<size_t> nThreads(m_names.size(), 0);
+			for (auto& tp : m_threads) {
+				for (size_t id = 0; id < tp->stats.size(); ++id) {
+					if (tp->stats[id].getCount() == 0) { continue; }
+					totals[id].merge(tp->stats[id]);
+					nThreads[id]++;
+				}
+				tp->stats.clear();
+			}
+			for (size_t id = 0; id < totals.size(); ++id) {
+				const TimerStats& tStats = totals[id];
+				if (tStats.getCount() == 0) { continue; }
 				std::stringstream stats;
 				stats << std::setprecision(3) << std::fixed;
-				stats << tStats.name;
+				stats << m_names[id];
 				stats << "\n\tcalled " << tStats.getCount() << " times";
+				if (nThreads[id] > 1) { stats << " on " << nThreads[id] << " threads"; }
 				stats << "\n\taverage: " << format(tStats.getMean());
 				stats << "\n\tminimum: " << format(tStats.getMin());
 				stats << "\n\tmaximum: " << format(tStats.getMax());
 				stats << "\n\t  total: " << format(tStats.getSum());
+				if (tStats.counterCount > 0) {
+					double cycles = tStats.getCounterMean(PerfEvent::cycles);
+					double instructions = tStats.getCounterMean(PerfEvent::instructions);
+					stats << "\n\tcounters (average per call):";
+					stats << "\n\t\t       cycles: " << cycles;
+					stats << "\n\t\t instructions: " << instructions;
+					stats << "\n\t\t          IPC: " << (cycles > 0.0 ? instructions / cycles : 0.0);
+					stats << "\n\t\t   LLC misses: " << tStats.getCounterMean(PerfEvent::llcMisses);
+					stats << "\n\t\tbranch misses: " << tStats.getCounterMean(PerfEvent::branchMisses);
+				}
 				stats << std::endl << std::endl;
 				m_statsStream << stats.str();
-				m_statsStream.flush();
 			}
+			m_statsStream.flush();
 		}
 
 		// format double (us) as value and appropriate time unit for easy reading
 		std::string format(double t) {
 			double div = 1.0;
-			char* unit = " us";
+			const char* unit = " us";
 			if (t > 1e6) {
 				unit = " s";
 				div = 1e6;
@@ -249,17 +404,29 @@ namespace molecool {
 		{
 			if (m_currentSession)
 			{
+				m_active.store(false, std::memory_order_release);
 				writeStatistics();
 				m_statsStream.close();
-				m_stats.clear();
 
+				// drain the remaining events through the writer, then stop it
+				if (m_writer.joinable()) {
+					for (auto& tp : m_threads) {
+						if (!tp->events.empty()) { submitEvents(tp->events); }
+					}
+					{
+						std::lock_guard lock(m_queueMutex);
+						m_stopWriter = true;
+					}
+					m_queueCondition.notify_one();
+					m_writer.join();
+				}
 				writeFooter();
 				m_outputStream.close();
 
 				delete m_currentSession;
 				m_currentSession = nullptr;
 			}
-			
+
 		}
 
 	};
@@ -267,9 +434,13 @@ namespace molecool {
 	class Timer
 	{
 	public:
-		Timer(const char* name)
-			: m_Name(name), m_Stopped(false)
+		Timer(const ProfileScope& scope)
+			: m_scope(scope), m_Stopped(false)
 		{
+			if (MC_PROFILE_COUNTERS && Profiler::get().isActive()) {
+				Profiler& profiler = Profiler::get();
+				m_hasCounters = profiler.readCounters(profiler.getThreadProfile(), m_startCounters);
+			}
 			m_StartTimepoint = std::chrono::steady_clock::now();
 		}
 
@@ -282,17 +453,28 @@ namespace molecool {
 		void Stop()
 		{
 			auto endTimepoint = std::chrono::steady_clock::now();
+			PerfValues endCounters;
+			bool hasCounters = m_hasCounters && Profiler::get().readCounters(Profiler::get().getThreadProfile(), endCounters);
 			auto highResStart = FloatingPointMicroseconds{ m_StartTimepoint.time_since_epoch() };
-			auto elapsedTime = std::chrono::time_point_cast<std::chrono::microseconds>(endTimepoint).time_since_epoch() - std::chrono::time_point_cast<std::chrono::microseconds>(m_StartTimepoint).time_since_epoch();
+			auto elapsedTime = FloatingPointMicroseconds{ endTimepoint - m_StartTimepoint };
 
-			Profiler::get().accumulate(m_Name, (double)elapsedTime.count());
+			m_Stopped = true;
+			Profiler& profiler = Profiler::get();
+			if (!profiler.isActive()) { return; }
+			ThreadProfile& tp = profiler.getThreadProfile();
+			profiler.accumulate(tp, m_scope, elapsedTime.count());
+			if (hasCounters) {
+				for (int e = 0; e < MC_PERF_EVENTS; ++e) { endCounters[e] -= m_startCounters[e]; }
+				profiler.accumulateCounters(tp, m_scope, endCounters);
+			}
 			if (MC_PROFILE_VERBOSE) {
-				Profiler::get().writeProfile({ m_Name, highResStart, elapsedTime, std::this_thread::get_id() });
+				profiler.writeProfile(tp, { m_scope.name, highResStart, elapsedTime, tp.threadIndex });
 			}
-			m_Stopped = true;
 		}
 	private:
-		const char* m_Name;
+		const ProfileScope& m_scope;
+		PerfValues m_startCounters;
+		bool m_hasCounters = false;
 		std::chrono::time_point<std::chrono::steady_clock> m_StartTimepoint;
 		bool m_Stopped;
 	};
@@ -19,6 +19,9 @@
 //--- Built-in observers -----------------------------------
 #include "assets/observers/Trajectorizer.h"
 #include "assets/observers/Staticizer.h"
+#include "assets/observers/Momentizer.h"
+#include "assets/observers/Histogrammer.h"
+#include "assets/observers/Detectorizer.h"
 //----------------------------------------------------------
 
 //--- Random number generation -----------------------------
@@ -27,6 +30,10 @@
 
 #include "core/Vector.h"
 
+//--- Interpolation tables of expensive forces -------------
+#include "core/TabulatedForce.h"
+//----------------------------------------------------------
+
 //--- Particle ensemble ------------------------------------
 #include "core/Ensemble.h"
 //----------------------------------------------------------
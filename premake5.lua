@@ -265,3 +265,102 @@ project "sandbox"
             "MC_RELEASE"
         }
 
+------------------------------------------------------------------
+project "molecool_bench"
+    location "bench"
+    kind "ConsoleApp"
+    language "C++"
+    cppdialect "C++17"
+    staticruntime "on"
+    systemversion "latest"
+
+    targetDir = "bin/" .. outputDir .. "/%{prj.name}"
+    targetdir (targetDir)
+    objdir ("build/" .. outputDir .. "/%{prj.name}")
+
+    files {
+        "bench/src/**.h",
+        "bench/src/**.cpp"
+    }
+
+    includedirs {
+        "molecool/src",
+        "molecool/vendor/spdlog/include",
+        boostDir,
+        mklIncDir,
+        "vendor/lua/src",
+        "molecool/vendor/nlohmann_json/include",
+        "vendor/sol/include"
+    }
+
+    libdirs {
+        mklLibDir,
+        mklOmpDir,
+        boostLibDir,
+        "bin/" .. outputDir .. "/lua"
+    }
+
+    links {
+        "molecool",
+        "mkl_intel_ilp64.lib",    
+        "mkl_intel_thread.lib",    
+        "mkl_core.lib",   
+        "libiomp5md.lib",
+        "lua.lib"
+    }
+
+    postbuildcommands {
+        ("{MKDIR} " .. "%{cfg.buildtarget.directory}" .. "output")  -- create directory for benchmark results
+    }
+
+    filter "system:windows"
+
+        defines {
+            "MC_PLATFORM_WINDOWS",
+            "NOMINMAX"
+        }
+
+        buildoptions {
+            "/openmp",
+            "/DMKL_ILP64"
+        }
+
+    filter "system:macosx"
+
+        defines {
+            "MC_PLATFORM_MACOSX"
+        }
+
+        buildoptions {
+            "-qopenmp",
+            "-DMKL_ILP64"
+        }
+
+    filter "system:linux"
+
+        defines {
+            "MC_PLATFORM_LINUX"
+        }
+
+        buildoptions {
+            "-qopenmp",
+            "-DMKL_ILP64"
+        }
+
+    filter "configurations:Debug"
+        symbols "On"
+        runtime "Debug"
+        
+        defines {
+            "_DEBUG",
+            "MC_DEBUG"
+        }
+
+    filter "configurations:Release"
+        optimize "Speed"
+        runtime "Release"
+        
+        defines {
+            "NDEBUG",
+            "MC_RELEASE"
+        }
@@ -59,6 +59,10 @@ namespace molecool {
 				return -k * pp.getPos();
 			};
 			addForce(sho3d);
+			//addForce(TabulatedForce(sho3d, { { { -1, 1, 33 }, { -1, 1, 33 }, { -1, 1, 33 } } }));				// or sampled once onto a grid, interpolated
+			//const SwitchingSchedule& stage = schedules["stage"];												// a time-dependent force, the
+			//addStagedForce([&stage](double t) { return Coefficients{ stage.value(t) }; },						// schedule is looked up once per step
+			//	[](const ParticleProxy& pp, const Coefficients& c) -> Force { return -c[0] * pp.getPos(); });
 			//////////////////////////////////////////////
 
 
@@ -5,9 +5,83 @@ startTime = 0.0
 endTime   = 1.0
 timestep  = 0.001
 
+-- (optional) checkpointing of the full simulation state, also on SIGUSR1 (checkpoint) and SIGTERM (checkpoint and stop)
+-- checkpoint = { interval = 0.1, file = "output/checkpoint.bin", resume = true }
+
+-- (optional) live throughput telemetry (steps/s, particle-steps/s, phase times, memory, ETA) as a Prometheus text file
+-- telemetry = { file = "output/metrics.prom", period = 5 }
+
+-- (optional) execution layer and memory placement for the parallel loops over particles
+-- scheduler = { policy = "native", threads = 8, chunk = 1024, pin = true }
+-- memory = { hugePages = true }
+
+-- (optional) temporal tiling: blocks of particles are advanced for many steps while in cache, observers synchronize
+-- at their sample times (so it only pays off with decimated observer schedules)
+-- propagation = { blockParticles = 2048, blockSteps = 256 }
+
+-- (optional) out-of-core runs: the ensemble is sampled and propagated in batches, peak memory is set by the batch size
+-- (the population may then be far larger than fits in memory, e.g. 1e10), observers accumulate over all batches
+-- batches = { size = 1000000, saveStates = false }
+-- with convergence observables the population is a budget, batches are run until the observables reach the target
+-- relative error (confidence interval half-width over mean), built-ins are "survival" and the temperatures "Tx", "Ty", "Tz"
+-- convergence = { observables = { "survival" }, relativeError = 0.01, confidence = 0.95, minBatches = 5, maxSeconds = 3600 }
+
+-- (optional) particle sources emitting during propagation, continuously or in pulses (period, duration), new particles
+-- fill the slots of lost ones within the capacity reserved for the source
+-- sources = {
+--     { rate = 1e5, capacity = 5000, from = 0.0, to = 0.5, period = 0.1, duration = 0.01,
+--       xDistribution  = {pdf = "gaussian", center = 0.0, width = 0.1}, vxDistribution = {pdf = "gaussian", center = 0.0, width = 0.1},
+--       yDistribution  = {pdf = "gaussian", center = 0.0, width = 0.1}, vyDistribution = {pdf = "gaussian", center = 0.0, width = 0.1},
+--       zDistribution  = {pdf = "gaussian", center = 0.0, width = 0.1}, vzDistribution = {pdf = "gaussian", center = 1.0, width = 0.1} }
+-- }
+
+-- (optional) parameter sweep, the points are run back to back from the same initial ensemble, the parameters are set as
+-- Lua globals and for the C++ code (Simulation::parameter), results go to output/sweep/<point>/, indexed in output/sweep.json
+-- sweep = { { name = "voltage", from = 0, to = 100, points = 11 }, { name = "delay", values = { 1e-3, 2e-3 } } }
+
+-- (optional) optimization of parameters (Nelder-Mead), every evaluation propagates the same initial ensemble, candidates that
+-- can no longer win are stopped early, the objective is minimized (by default the final population is maximized)
+-- optimize = { parameters = { { name = "delay", initial = 1e-3, step = 2e-4, min = 0, max = 1e-2 } }, evaluations = 200,
+--              objective = function(population, results) return -results[1].pop end }
+-- results holds a summary of each observer (in the order of the observers table), e.g. the final pop of Statistics, the
+-- last t, pop, mean_x, vvar_x, T_x, emittance_x, psd of Moments, the number of crossings of each detector by name
+
+-- (optional) switching schedules, piecewise in time (held, or linear = true), optionally periodic, usable by name in the
+-- expressions below and by staged forces in C++ (looked up once per step, not per particle)
+-- schedules = { stage = { times = { 0, 1e-4, 2e-4 }, values = { 1, 0, 1 }, period = 3e-4 } }
+
+-- (optional) forces and filters as expressions of x, y, z, vx, vy, vz, r, speed, t, parameters (Lua globals or swept
+-- or optimized parameters) and schedules, compiled once and evaluated natively, a missing force component is zero, a particle is stopped
+-- where a filter is nonzero
+-- k = 2.0
+-- forces = { { x = "-k*x", y = "-k*y", z = "-k*z" } }
+-- forces = { { z = "-stage*k*z" } }
+-- filters = { "r > 0.01", "abs(z) > 0.005 && t > 1e-3" }
+-- elements may also be Lua functions, called in parallel (on per-thread copies of this script) for batches of active particles
+-- forces = { function(batch, t)
+--     for i = 1, batch.size do
+--         local p = batch:particle(i)
+--         batch:setForce(i, Vector(-k * p:getX(), 0, math.sin(t)))
+--     end
+-- end }
+-- filters = { function(batch, t) for i = 1, batch.size do if batch:particle(i):getZ() > 0.5 then batch:stop(i) end end end }
+
+-- (optional) beamline of elements localized along the beam axis, with forces and aperture filters (as above) acting only
+-- within [from, to], every particle is only evaluated for the elements it is in
+-- beamline = { axis = "z", elements = {
+--     { name = "skimmer",  from = 0.100, to = 0.101, filters = { "x^2 + y^2 > 1e-6" } },
+--     { name = "hexapole", from = 0.2,   to = 0.35,  forces = { { x = "-k*x", y = "-k*y" } }, filters = { "x^2 + y^2 > 4e-6" } } } }
+
+-- (optional) apertures (circle, rectangle, annulus, plane) and tubes, particles are tested along the straight segment of
+-- every step, so thin plates are not jumped over at coarse timesteps
+-- geometry = { axis = "z", apertures = {
+--     { shape = "circle", at = 0.1, radius = 1e-3, center = { 0.0, 0.0 } },
+--     { shape = "tube", from = 0.4, to = 0.6, radius = 3e-3 } } }
+
 -- ensemble control
 ensemble = {
     population = 1000,
+    --seed = 12345,           -- (optional) reproducible sampling, otherwise seeded from the clock
     --species = "CaF",
     xDistribution  = {pdf = "gaussian", center = 0.1, width = 1.1},
     vxDistribution = {pdf = "gaussian", center = 0.2, width = 1.2},
@@ -17,6 +91,15 @@ ensemble = {
     vzDistribution = {pdf = "delta", center = 0.6}
 }
 
-observers = { Trajectories(5), Statistics() }
+-- observers are deployed every timestep, unless they are given a schedule:
+-- every = N steps, interval = simulation time, from/to = active window, populationBelow/populationAbove = triggers
+observers = {
+    Trajectories(5),
+    Trajectories(100, 1e-3),
+    {observer = Statistics(), interval = 0.01},
+    {observer = Moments(), interval = 0.01},       -- Moments(mass) with the species mass in kg also writes temperatures
+    {observer = Histogram("x", 100, -5.0, 5.0, "vx", 100, -5.0, 5.0), interval = 0.1},
+    Detectors("x", {-1.0, 0.0, 1.0})
+}
 
 